@@ -18,17 +18,21 @@ int main() {
         std::print("{}\n", e.what());
     }
 
+    // The window is transparent, so everything is drawn with premultiplied alpha.
+    premultiply_alpha(ui.data(), ui.data());
+
     size_t screen_width  = GetSystemMetrics(SM_CXSCREEN);
     size_t screen_height = GetSystemMetrics(SM_CYSCREEN);
 
     color_buffer color_buf{screen_width, screen_height};
 
     window win{
-        {.title       = "",
-         .width       = static_cast<i32>(screen_width),
-         .height      = static_cast<i32>(screen_height),
-         .default_ui  = false,
-         .transparent = true}
+        {.title               = "",
+         .width               = static_cast<i32>(screen_width),
+         .height              = static_cast<i32>(screen_height),
+         .default_ui          = false,
+         .transparent         = true,
+         .premultiplied_alpha = true}
     };
 
     win.set_icon(icon);
@@ -41,14 +45,16 @@ int main() {
         vlk::render_rect_color({
             .dst = {{100, 100}, {700, 500}},
               .color = {255, 255, 255, 255},
-              .color_buf = color_buf
+              .color_buf = color_buf,
+              .blend = blend_mode::premultiplied
         });
 
         vlk::blit_image({
             .dst       = {150,    150                      },
             .src       = {{0, 0}, {ui.width(), ui.height()}},
             .image     = ui,
-            .color_buf = color_buf
+            .color_buf = color_buf,
+            .blend     = blend_mode::premultiplied
         });
 
         win.swap_buffers(color_buf);
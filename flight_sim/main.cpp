@@ -17,7 +17,7 @@ int main() {
     std::print("Loading assets...\n");
 
     try {
-        model = vlk::load_obj("../assets/lexus/lexus.obj");
+        model = vlk::load_obj("../assets/lexus/lexus.obj", true, true);
         music = vlk::load_sound_wav_pcm_s16le("../assets/drake.wav");
         boom  = vlk::load_sound_wav_pcm_s16le("../assets/vine_boom.wav");
         icon  = vlk::load_image("../assets/runescape.ico");
@@ -34,8 +34,8 @@ int main() {
 
     win.set_icon(icon);
 
-    color_buffer color_buf{width, height};
-    depth_buffer depth_buf{width, height};
+    color_buffer color_buf{width, height, buffer_layout::tiled};
+    depth_buffer depth_buf{width, height, buffer_layout::tiled};
 
     const mat4 projection_matrix = vlk::perspective(
         static_cast<f32>(width) / height, 70 * static_cast<f32>(std::numbers::pi) / 180, 0.001f, 1000.0f);
@@ -58,11 +58,16 @@ int main() {
         mat4 mvp_matrix    = model_matrix * view_matrix * projection_matrix;
         mat3 normal_matrix = model_matrix.inverse().transpose();
 
-        vlk::render_model({.model         = model,
-                           .mvp_matrix    = mvp_matrix,
-                           .normal_matrix = normal_matrix,
-                           .color_buf     = color_buf,
-                           .depth_buf     = depth_buf});
+        [[maybe_unused]] const size_t copied_bytes = model::copied_bytes;
+
+        vlk::render_model(basic_render_model_params{.model         = model,
+                                                    .mvp_matrix    = mvp_matrix,
+                                                    .normal_matrix = normal_matrix,
+                                                    .color_buf     = color_buf,
+                                                    .depth_buf     = depth_buf,
+                                                    .multithreaded = true});
+
+        VLK_ASSERT(model::copied_bytes == copied_bytes, "Drawing the model must not copy it.");
 
         win.swap_buffers(color_buf);
     }
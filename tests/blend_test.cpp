@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "vlk.gfx.hpp"
+#include "test.hpp"
+
+using namespace vlk;
+using vlk::test::check;
+
+static std::mt19937 random_engine{1};
+
+static u8 random_u8() { return static_cast<u8>(random_engine()); }
+
+// The float alpha blend that blend(blend_mode::alpha, ...) replaced, as it was.
+static color_rgba float_color_blend(const color_rgba &old_color, const color_rgba &new_color) {
+    vec4f ol = old_color;
+    vec4f ne = new_color;
+
+    ol.a() /= 255;
+    ne.a() /= 255;
+
+    f32 a = ne.a() + ol.a() * (1.0f - ne.a());
+
+    return {ne.rgb() * ne.a() + ol.rgb() * ol.a() * (1.0f - ne.a()) / a, a * 255.0f};
+}
+
+// Every pair of alphas with extreme and random colors. Results may be 1 higher than the float version's,
+// which truncated where blend() rounds.
+static void test_alpha_blend() {
+    for (u32 old_a = 0; old_a < 256; ++old_a) {
+        for (u32 new_a = 0; new_a < 256; ++new_a) {
+            // The float version divides by zero when both are transparent.
+            if (old_a == 0 && new_a == 0) {
+                continue;
+            }
+
+            color_rgba colors[][2] = {
+                {{0, 255, 255, 0}, {255, 0, 255, 0}},
+                {{0, 0, 128, 0}, {0, 0, 127, 0}},
+                {{random_u8(), random_u8(), random_u8(), 0}, {random_u8(), random_u8(), random_u8(), 0}},
+                {{random_u8(), random_u8(), random_u8(), 0}, {random_u8(), random_u8(), random_u8(), 0}},
+            };
+
+            for (auto [old_color, new_color] : colors) {
+                old_color.a() = static_cast<u8>(old_a);
+                new_color.a() = static_cast<u8>(new_a);
+
+                const color_rgba result   = blend(blend_mode::alpha, old_color, new_color);
+                const color_rgba expected = float_color_blend(old_color, new_color);
+
+                for (i32 i = 0; i < 4; ++i) {
+                    if (!check(std::abs(result[i] - expected[i]) <= 1, "blend(blend_mode::alpha, ...)")) {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Alphas of the pixels and colors blended into them. The SSE2 path handles runs of 4 pixels that are all
+// opaque or all transparent, and falls back to blend() for the rest.
+enum class alpha_mix {
+    opaque,
+    clear,
+    random,
+    opaque_or_clear,
+};
+
+static std::vector<color_rgba> random_colors(size_t count, alpha_mix alphas) {
+    std::vector<color_rgba> colors(count);
+
+    for (color_rgba &color : colors) {
+        color = {random_u8(), random_u8(), random_u8(), random_u8()};
+
+        switch (alphas) {
+            case alpha_mix::opaque:
+                color.a() = 255;
+                break;
+            case alpha_mix::clear:
+                color.a() = 0;
+                break;
+            case alpha_mix::random:
+                break;
+            case alpha_mix::opaque_or_clear:
+                color.a() = random_engine() % 2 == 0 ? 255 : 0;
+                break;
+        }
+    }
+
+    return colors;
+}
+
+// blend_span() gives the same bytes as blend() pixel by pixel, for every mode.
+static void test_blend_span() {
+    constexpr blend_mode modes[]      = {blend_mode::replace, blend_mode::alpha, blend_mode::add,
+                                         blend_mode::multiply, blend_mode::premultiplied};
+    constexpr alpha_mix alpha_mixes[] = {alpha_mix::opaque, alpha_mix::clear, alpha_mix::random,
+                                         alpha_mix::opaque_or_clear};
+    constexpr size_t pixel_counts[]   = {0, 1, 3, 4, 5, 7, 9, 15, 17, 33, 257};
+
+    for (const blend_mode mode : modes) {
+        for (const alpha_mix pixel_alphas : alpha_mixes) {
+            for (const alpha_mix color_alphas : alpha_mixes) {
+                for (const size_t count : pixel_counts) {
+                    const std::vector<color_rgba> pixels = random_colors(count, pixel_alphas);
+                    const std::vector<color_rgba> colors = random_colors(count, color_alphas);
+
+                    std::vector<color_rgba> expected = pixels;
+                    std::vector<color_rgba> result   = pixels;
+
+                    for (size_t i = 0; i < count; ++i) {
+                        expected[i] = blend(mode, pixels[i], colors[i]);
+                    }
+
+                    blend_span(mode, result, colors);
+                    check(result == expected, "blend_span");
+
+                    // A single color with the same alpha mix.
+                    const color_rgba color = random_colors(1, color_alphas)[0];
+
+                    for (size_t i = 0; i < count; ++i) {
+                        expected[i] = blend(mode, pixels[i], color);
+                    }
+
+                    result = pixels;
+                    blend_span(mode, result, color);
+                    check(result == expected, "blend_span of a single color");
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    if (!vlk::test::is_simd_supported()) {
+        return vlk::test::skipped;
+    }
+
+    test_alpha_blend();
+    test_blend_span();
+
+    return vlk::test::exit_code();
+}
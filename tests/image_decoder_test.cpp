@@ -0,0 +1,493 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "vlk.image_decoder.hpp"
+#include "test.hpp"
+
+using namespace vlk;
+using vlk::test::check;
+
+/*
+ * Decodes the images in assets/ and checks them against hashes of earlier decodes, which are the same for
+ * every SIMD level. The JPEGs were within 3 levels of libjpeg-turbo with its default settings when the hashes
+ * were made, and the PNGs exactly the same as libpng. Run with --print-hashes to print new ones after a
+ * change to the decoder that is meant to change its output.
+ */
+struct expected_image {
+    const char *path;  // In assets/.
+    image_file_format format;
+    size_t width;
+    size_t height;
+    u64 hash;
+};
+
+static constexpr expected_image expected_images[] = {
+    {"bonzi_buddy.png", image_file_format::png, 180, 180, 0x244dcc45e6c4654aull},
+    {"frog.ico", image_file_format::ico, 128, 128, 0x19d64147fd378a4eull},
+    {"frog.png", image_file_format::png, 320, 221, 0x17c6f7947279784full},
+    {"frog_with_margin.png", image_file_format::png, 400, 300, 0x628e5f80837b3574ull},
+    {"lexus/original_res_lexus.jpg", image_file_format::jpeg, 1024, 1024, 0x121f63a701eea5eeull},
+    {"runescape.ico", image_file_format::ico, 256, 256, 0x5efaae9829bfe44aull},
+    {"ship/BACK.JPG", image_file_format::jpeg, 425, 390, 0x9699246b277b6f9dull},
+    {"ship/BARREL.JPG", image_file_format::jpeg, 319, 500, 0x6b3e38aa0b26b107ull},
+    {"ship/BARRELT.JPG", image_file_format::jpeg, 299, 300, 0x7f6ab1f01d7241d5ull},
+    {"ship/BLACK.JPG", image_file_format::jpeg, 169, 159, 0x062433223a0119fcull},
+    {"ship/BODY.JPG", image_file_format::jpeg, 3000, 2000, 0x419ef987c17de232ull},
+    {"ship/CANON.JPG", image_file_format::jpeg, 136, 836, 0x555b699d227bb9ebull},
+    {"ship/CARPET.JPG", image_file_format::jpeg, 320, 480, 0x2ebb4be9bb2909e4ull},
+    {"ship/CRATE.JPG", image_file_format::jpeg, 488, 488, 0xd611406f5f87e71bull},
+    {"ship/EARTH.JPG", image_file_format::jpeg, 500, 400, 0xb418f4a93f253bf1ull},
+    {"ship/FABRIC.JPG", image_file_format::jpeg, 1000, 500, 0x5873caca6e0f7e93ull},
+    {"ship/LANO2.JPG", image_file_format::jpeg, 117, 249, 0x560f286ceba9f3bcull},
+    {"ship/LETTER.JPG", image_file_format::jpeg, 286, 400, 0x46833597fb394d83ull},
+    {"ship/LETTERC.JPG", image_file_format::jpeg, 286, 400, 0x7ed325a1bd19779bull},
+    {"ship/LIGHT.JPG", image_file_format::jpeg, 300, 500, 0x394067db94b23e21ull},
+    {"ship/OR1.JPG", image_file_format::jpeg, 1400, 500, 0xee67087c826aa536ull},
+    {"ship/ORN1.JPG", image_file_format::jpeg, 224, 210, 0x349ecf04e8921d03ull},
+    {"ship/ORN10.JPG", image_file_format::jpeg, 597, 458, 0x18bdb7f801f318fdull},
+    {"ship/ORN2.JPG", image_file_format::jpeg, 372, 77, 0x8da66fe46a7283e8ull},
+    {"ship/ORN3.JPG", image_file_format::jpeg, 585, 154, 0x452472c7c86be4a2ull},
+    {"ship/ORN4.JPG", image_file_format::jpeg, 599, 111, 0x41cc599853a7f61bull},
+    {"ship/ORN4D.JPG", image_file_format::jpeg, 599, 111, 0x7483d0513bd58dfaull},
+    {"ship/ORN5.JPG", image_file_format::jpeg, 262, 252, 0xc2ed3d7762da05b8ull},
+    {"ship/ORN6.JPG", image_file_format::jpeg, 617, 484, 0xeff04f75388ec8e5ull},
+    {"ship/ORN7V.JPG", image_file_format::jpeg, 617, 484, 0x98f1b41aae7a67e8ull},
+    {"ship/ROPE.JPG", image_file_format::jpeg, 117, 498, 0x1249e4c9ef82414eull},
+    {"ship/SAILF.JPG", image_file_format::jpeg, 500, 800, 0x10267ab8dd5c6585ull},
+    {"ship/SAILTOP.JPG", image_file_format::jpeg, 1000, 592, 0xf47c5b678fb9ebceull},
+    {"ship/SAIL_M.JPG", image_file_format::jpeg, 1000, 593, 0x1666dd5ed896f0e9ull},
+    {"ship/TABLE.JPG", image_file_format::jpeg, 834, 465, 0xe038d38648447c7full},
+    {"ship/TOP.JPG", image_file_format::jpeg, 170, 111, 0x18b50e99e044765dull},
+    {"ship/TX1A.JPG", image_file_format::jpeg, 500, 500, 0x06365b782224817aull},
+    {"ship/TX1B.JPG", image_file_format::jpeg, 500, 500, 0x23dfc2331fd72b7full},
+    {"ship/WD10.JPG", image_file_format::jpeg, 617, 484, 0xf81f378c611012e9ull},
+    {"ship/WD11.JPG", image_file_format::jpeg, 350, 350, 0x519e0188cbbcd893ull},
+    {"ship/WD12.JPG", image_file_format::jpeg, 617, 484, 0xc293d8a9124bce62ull},
+    {"ship/WD12D.JPG", image_file_format::jpeg, 617, 111, 0x7497b06813669149ull},
+    {"ship/WD12X.JPG", image_file_format::jpeg, 617, 111, 0x4dddc2e8f6386410ull},
+    {"ship/WD2.JPG", image_file_format::jpeg, 647, 101, 0xbd29d3698eff74fbull},
+    {"ship/WD5.JPG", image_file_format::jpeg, 1468, 512, 0x694821c778e07ec3ull},
+    {"ship/WD6.JPG", image_file_format::jpeg, 350, 148, 0xae8270cef0eea910ull},
+    {"ship/WDWALL.JPG", image_file_format::jpeg, 1280, 918, 0x2600a5cefd544fa3ull},
+    {"ship/WDX.JPG", image_file_format::jpeg, 599, 111, 0xe4ec4e52c7f041b9ull},
+    {"ship/WOODD.JPG", image_file_format::jpeg, 800, 510, 0xc0aa751c0f41e24cull},
+    {"ship/WOODD2.JPG", image_file_format::jpeg, 800, 510, 0x6cecf4136c7c4820ull},
+    {"ship/WOODS.JPG", image_file_format::jpeg, 521, 171, 0x9b07d8fa17f9e192ull},
+    {"terrain.png", image_file_format::png, 256, 256, 0x61e87fe4939995d7ull},
+    {"windows_ui.png", image_file_format::png, 404, 101, 0x1ea6e79bf0d39037ull},
+};
+
+static std::vector<u8> read_file(const std::filesystem::path &path) {
+    std::ifstream file{path, std::ios::binary};
+    return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+// FNV-1a of the size and pixels of an image.
+static u64 hash_image(const image &decoded) {
+    u64 hash = 14695981039346656037ull;
+
+    const auto add = [&](std::span<const u8> bytes) {
+        for (const u8 byte : bytes) {
+            hash = (hash ^ byte) * 1099511628211ull;
+        }
+    };
+
+    const std::array<u64, 3> size{decoded.width(), decoded.height(), decoded.channels()};
+    add({reinterpret_cast<const u8 *>(size.data()), sizeof(size)});
+    add(decoded.data());
+
+    return hash;
+}
+
+static bool is_flipped(const image &decoded, const image &flipped) {
+    const size_t row_size = decoded.width() * decoded.channels();
+
+    if (flipped.width() != decoded.width() || flipped.height() != decoded.height()) {
+        return false;
+    }
+
+    for (size_t y = 0; y < decoded.height(); ++y) {
+        const u8 *row         = decoded.data().data() + y * row_size;
+        const u8 *flipped_row = flipped.data().data() + (decoded.height() - 1 - y) * row_size;
+
+        if (std::memcmp(row, flipped_row, row_size) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Whether decoding data either gives an image or throws std::runtime_error, and nothing else happens.
+static bool decodes_or_throws(std::span<const u8> data) {
+    try {
+        decode_image(data);
+    } catch (const std::runtime_error &) {
+    } catch (...) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool throws(std::span<const u8> data) {
+    try {
+        decode_image(data);
+    } catch (const std::runtime_error &) {
+        return true;
+    }
+
+    return false;
+}
+
+static void test_assets(bool print_hashes) {
+    for (const auto &expected : expected_images) {
+        const std::vector<u8> data = read_file(std::filesystem::path{VLK_ASSETS_DIR} / expected.path);
+
+        if (!check(!data.empty(), expected.path)) {
+            continue;
+        }
+
+        check(detect_image_format(data) == expected.format, expected.path);
+
+        const image decoded = decode_image(data);
+        const image flipped = decode_image(data, true);
+        const u64 hash      = hash_image(decoded);
+
+        if (print_hashes) {
+            std::printf("    {\"%s\", image_file_format::%s, %zu, %zu, 0x%016llxull},\n", expected.path,
+                        expected.format == image_file_format::png    ? "png"
+                        : expected.format == image_file_format::jpeg ? "jpeg"
+                        : expected.format == image_file_format::bmp  ? "bmp"
+                                                                     : "ico",
+                        decoded.width(), decoded.height(), static_cast<unsigned long long>(hash));
+        }
+
+        check(decoded.width() == expected.width && decoded.height() == expected.height, expected.path);
+        check(decoded.channels() == 4, expected.path);
+        check(hash == expected.hash, expected.path);
+        check(is_flipped(decoded, flipped), expected.path);
+    }
+}
+
+// A BMP file with a BITMAPINFOHEADER, followed by the masks, palette and pixels.
+static std::vector<u8> make_bmp(i32 width, i32 height, u16 bit_count, u32 compression,
+                                std::span<const u32> masks, std::span<const u8> palette,
+                                std::span<const u8> pixels) {
+    std::vector<u8> data;
+
+    const auto add = [&](u64 value, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            data.push_back(static_cast<u8>(value >> i * 8));
+        }
+    };
+
+    const size_t pixels_offset = 14 + 40 + masks.size() * 4 + palette.size();
+
+    data = {'B', 'M'};
+    add(pixels_offset + pixels.size(), 4);
+    add(0, 4);
+    add(pixels_offset, 4);
+
+    add(40, 4);
+    add(static_cast<u32>(width), 4);
+    add(static_cast<u32>(height), 4);
+    add(1, 2);
+    add(bit_count, 2);
+    add(compression, 4);
+    add(0, 4);  // Image size, which uncompressed bitmaps don't need.
+    add(0, 4);  // Resolution.
+    add(0, 4);
+    add(palette.size() / 4, 4);
+    add(0, 4);  // Important colors.
+
+    for (const u32 mask : masks) {
+        add(mask, 4);
+    }
+
+    data.insert(data.end(), palette.begin(), palette.end());
+    data.insert(data.end(), pixels.begin(), pixels.end());
+
+    return data;
+}
+
+// Every pixel layout decode_dib() supports, against the pixels the files were made from. The width is odd,
+// so rows are padded to 4 bytes.
+static void test_bmp() {
+    constexpr i32 width  = 5;
+    constexpr i32 height = 3;
+
+    const auto source = [](size_t x, size_t y) {
+        return std::array<u8, 4>{static_cast<u8>(x * 50), static_cast<u8>(y * 80),
+                                 static_cast<u8>(x * 20 + y), static_cast<u8>(255 - x * 10 - y)};
+    };
+
+    struct bmp_case {
+        const char *name;
+        u16 bit_count;
+        u32 compression;
+        std::vector<u32> masks;
+        bool is_top_down;
+    };
+
+    const bmp_case cases[] = {
+        {"1-bit", 1, 0, {}, false},
+        {"4-bit", 4, 0, {}, true},
+        {"8-bit", 8, 0, {}, false},
+        {"16-bit", 16, 0, {}, false},
+        {"16-bit 565", 16, 3, {0xf800, 0x07e0, 0x001f}, true},
+        {"24-bit", 24, 0, {}, false},
+        {"24-bit top down", 24, 0, {}, true},
+        {"32-bit", 32, 0, {}, false},
+        {"32-bit BGRA", 32, 6, {0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000}, true},
+        {"32-bit RGBA", 32, 6, {0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000}, false},
+    };
+
+    for (const auto &bmp : cases) {
+        const size_t stride = (width * bmp.bit_count + 31) / 32 * 4;
+        std::vector<u8> palette;
+        std::vector<u8> pixels(stride * height);
+        std::vector<u8> expected(width * height * 4);
+
+        // Palettes map index i to {i * 3, 255 - i, i * 7}.
+        if (bmp.bit_count <= 8) {
+            for (size_t i = 0; i < (size_t{1} << bmp.bit_count); ++i) {
+                palette.insert(palette.end(), {static_cast<u8>(i * 7), static_cast<u8>(255 - i),
+                                               static_cast<u8>(i * 3), 0});
+            }
+        }
+
+        for (size_t y = 0; y < height; ++y) {
+            const size_t row = bmp.is_top_down ? y : height - 1 - y;
+            u8 *src          = pixels.data() + row * stride;
+            u8 *dst          = expected.data() + y * width * 4;
+
+            for (size_t x = 0; x < width; ++x) {
+                const auto [r, g, b, a] = source(x, y);
+
+                // What the decoder has to give for the pixel.
+                std::array<u8, 4> color{r, g, b, 255};
+
+                if (bmp.bit_count <= 8) {
+                    const size_t index = (x + y * width) % (size_t{1} << bmp.bit_count);
+                    const size_t bit   = x * bmp.bit_count;
+
+                    src[bit / 8] |= static_cast<u8>(index << (8 - bmp.bit_count - bit % 8));
+                    color = {static_cast<u8>(index * 3), static_cast<u8>(255 - index),
+                             static_cast<u8>(index * 7), 255};
+                } else if (bmp.bit_count == 16) {
+                    // 5 bits per channel, or 5, 6 and 5 with the masks.
+                    const u32 g_bits = bmp.masks.empty() ? 5 : 6;
+                    const u32 g_max  = (1u << g_bits) - 1;
+                    const u32 pixel  = (r >> 3) << (5 + g_bits) | (g >> (8 - g_bits)) << 5 | b >> 3;
+
+                    std::memcpy(src + x * 2, &pixel, 2);
+                    color = {static_cast<u8>((r >> 3) * 255 / 31),
+                             static_cast<u8>((g >> (8 - g_bits)) * 255 / g_max),
+                             static_cast<u8>((b >> 3) * 255 / 31), 255};
+                } else if (bmp.bit_count == 24) {
+                    std::ranges::copy(std::array<u8, 3>{b, g, r}, src + x * 3);
+                } else {
+                    // Without masks the fourth byte is unused, and the image opaque.
+                    const u32 r_shift = bmp.masks.empty() ? 16 : std::countr_zero(bmp.masks[0]);
+                    const u32 b_shift = bmp.masks.empty() ? 0 : std::countr_zero(bmp.masks[2]);
+                    const u32 pixel   = u32{r} << r_shift | u32{g} << 8 | u32{b} << b_shift | u32{a} << 24;
+
+                    std::memcpy(src + x * 4, &pixel, 4);
+                    color[3] = bmp.masks.empty() ? 255 : a;
+                }
+
+                std::ranges::copy(color, dst + x * 4);
+            }
+        }
+
+        const std::vector<u8> data =
+            make_bmp(width, bmp.is_top_down ? -height : height, bmp.bit_count, bmp.compression, bmp.masks,
+                     palette, pixels);
+
+        check(detect_image_format(data) == image_file_format::bmp, bmp.name);
+
+        const image decoded = decode_image(data);
+
+        check(decoded.width() == width && decoded.height() == height && decoded.channels() == 4, bmp.name);
+        check(std::ranges::equal(decoded.data(), expected), bmp.name);
+        check(is_flipped(decoded, decode_image(data, true)), bmp.name);
+    }
+}
+
+// Progressive JPEGs aren't supported.
+static void test_unsupported() {
+    const std::vector<u8> data = read_file(std::filesystem::path{VLK_ASSETS_DIR} / "lexus/lexus.jpg");
+
+    check(detect_image_format(data) == image_file_format::unknown, "progressive JPEG");
+    check(throws(data), "progressive JPEG");
+}
+
+// Files cut off anywhere throw, except JPEGs cut off in the entropy coded data, whose missing data is
+// read as zero bits like libjpeg does. The last 8 bytes cut off the type of the IEND chunk of PNGs, as CRCs
+// aren't checked.
+static void test_truncated() {
+    for (const auto &expected : expected_images) {
+        const std::vector<u8> data = read_file(std::filesystem::path{VLK_ASSETS_DIR} / expected.path);
+
+        for (const size_t size : {size_t{0}, size_t{1}, size_t{8}, size_t{32}, size_t{100}, data.size() / 4,
+                                  data.size() / 2, data.size() - 8}) {
+            const std::span<const u8> truncated{data.data(), std::min(size, data.size())};
+
+            if (expected.format == image_file_format::jpeg && size >= data.size() / 4) {
+                check(decodes_or_throws(truncated), expected.path);
+            } else {
+                check(throws(truncated), expected.path);
+            }
+        }
+    }
+}
+
+// The first segment with the given JPEG marker, from its length.
+static size_t find_jpeg_segment(std::span<const u8> data, u8 marker) {
+    for (size_t pos = 2; pos + 4 <= data.size();) {
+        if (data[pos + 1] == marker) {
+            return pos + 2;
+        }
+
+        pos += 2 + (data[pos + 2] << 8 | data[pos + 3]);
+    }
+
+    return 0;
+}
+
+static void test_corrupt() {
+    const std::filesystem::path assets{VLK_ASSETS_DIR};
+
+    // A Huffman table with 3 codes of length 1, where only 2 fit.
+    {
+        std::vector<u8> data = read_file(assets / "ship/BARREL.JPG");
+        const size_t dht     = find_jpeg_segment(data, 0xc4);
+
+        if (check(dht != 0, "BARREL.JPG has no DHT segment")) {
+            u8 *counts       = data.data() + dht + 3;
+            const auto other = std::find_if(counts + 1, counts + 16, [](u8 count) { return count >= 3; });
+
+            // Moved from another length, so the table has as many symbols as before.
+            if (check(other != counts + 16, "DHT segment has no length with 3 codes")) {
+                *other -= 3;
+                counts[0] += 3;
+                check(throws(data), "oversubscribed Huffman table");
+            }
+        }
+    }
+
+    // A JPEG frame with components sampled 3 and 2 times horizontally, where 3 isn't a multiple of 2.
+    {
+        std::vector<u8> data = read_file(assets / "ship/BARREL.JPG");
+        const size_t sof     = find_jpeg_segment(data, 0xc0);
+
+        if (check(sof != 0 && data[sof + 7] == 3, "BARREL.JPG has no baseline YCbCr frame")) {
+            data[sof + 9]  = 0x31;
+            data[sof + 12] = 0x21;
+            check(throws(data), "JPEG sampling factors");
+        }
+    }
+
+    // PNG sizes and formats. The IHDR data starts at 16, there are no CRC checks.
+    {
+        const std::vector<u8> png = read_file(assets / "frog.png");
+
+        std::vector<u8> data = png;
+        std::fill_n(data.begin() + 16, 4, u8{0});
+        check(throws(data), "PNG width of 0");
+
+        data = png;
+        std::fill_n(data.begin() + 20, 4, u8{0xff});
+        check(throws(data), "huge PNG height");
+
+        data     = png;
+        data[24] = 7;
+        check(throws(data), "PNG bit depth of 7");
+
+        data     = png;
+        data[25] = 5;
+        check(throws(data), "PNG color type of 5");
+    }
+
+    // BMP sizes and offsets.
+    {
+        const std::array<u8, 4> pixel{};
+        const std::vector<u8> bmp = make_bmp(1, 1, 24, 0, {}, {}, pixel);
+
+        check(!throws(bmp), "valid 1x1 BMP");
+        check(throws(make_bmp(0, 1, 24, 0, {}, {}, pixel)), "BMP width of 0");
+        check(throws(make_bmp(1 << 25, 1, 24, 0, {}, {}, pixel)), "huge BMP width");
+        check(throws(make_bmp(1 << 12, 1 << 12, 24, 0, {}, {}, pixel)), "BMP larger than its data");
+        check(throws(make_bmp(1, 1, 7, 0, {}, {}, pixel)), "BMP bit count of 7");
+        check(throws(make_bmp(1, 1, 24, 1, {}, {}, pixel)), "RLE compressed BMP");
+
+        std::vector<u8> data = bmp;
+        data[10]             = 0xff;
+        data[13]             = 0x7f;
+        check(throws(data), "BMP pixels past the end");
+    }
+
+    // ICO directory entries that point past the end. Entries are 16 bytes from 6 on, with the size of the
+    // image at 8 and its offset at 12.
+    {
+        const std::vector<u8> ico = read_file(assets / "runescape.ico");
+        const size_t count        = ico[4] | ico[5] << 8;
+
+        for (const size_t field : {8, 12}) {
+            std::vector<u8> data = ico;
+
+            for (size_t i = 0; i < count; ++i) {
+                data[6 + i * 16 + field + 3] = 0x7f;
+            }
+
+            check(throws(data), field == 8 ? "ICO image size past the end" : "ICO image offset past the end");
+        }
+
+        std::vector<u8> data = ico;
+        data[4]              = 0;
+        data[5]              = 0;
+        check(throws(data), "ICO without images");
+    }
+
+    // Random bytes changed in each file, which has to give an image or throw, e.g. under a sanitizer.
+    std::mt19937 random{1};
+
+    for (const auto &expected : expected_images) {
+        const std::vector<u8> data = read_file(assets / expected.path);
+
+        for (size_t i = 0; i < 8 && !data.empty(); ++i) {
+            std::vector<u8> corrupt = data;
+
+            for (size_t j = 0; j < 4; ++j) {
+                corrupt[random() % corrupt.size()] = static_cast<u8>(random());
+            }
+
+            check(decodes_or_throws(corrupt), expected.path);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (!vlk::test::is_simd_supported()) {
+        return vlk::test::skipped;
+    }
+
+    const bool print_hashes = argc > 1 && std::string_view{argv[1]} == "--print-hashes";
+
+    test_assets(print_hashes);
+
+    if (!print_hashes) {
+        test_bmp();
+        test_unsupported();
+        test_truncated();
+        test_corrupt();
+    }
+
+    return vlk::test::exit_code();
+}
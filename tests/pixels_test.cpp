@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "vlk.pixels.hpp"
+#include "test.hpp"
+
+using namespace vlk;
+using vlk::test::check;
+
+/*
+ * Each kernel against a scalar reference written from its description in vlk.pixels.hpp. Spans have odd
+ * lengths, so the scalar tails after the SIMD loops run too. Each kernel is also run a pixel at a time,
+ * which only takes the scalar tail, and has to give the same bytes as on the whole span.
+ */
+
+// Span lengths in pixels, around the 4, 8 and 16 byte steps of the SIMD loops.
+static constexpr size_t pixel_counts[] = {0, 1, 3, 5, 7, 9, 15, 17, 31, 33, 65, 255, 257};
+
+static std::mt19937 random_engine{1};
+
+static std::vector<u8> random_bytes(size_t size) {
+    std::vector<u8> bytes(size);
+    std::ranges::generate(bytes, [] { return static_cast<u8>(random_engine()); });
+    return bytes;
+}
+
+template <typename Dst, typename Src>
+using kernel = void (*)(std::span<Dst>, std::span<const Src>);
+
+// Runs a kernel a pixel at a time, with src_size and dst_size values per pixel.
+template <typename Dst, typename Src>
+static std::vector<Dst> run_per_pixel(kernel<Dst, Src> function, std::span<const Src> src, size_t src_size,
+                                      size_t dst_size) {
+    std::vector<Dst> dst(src.size() / src_size * dst_size);
+
+    for (size_t i = 0; i < src.size() / src_size; ++i) {
+        function(std::span{dst}.subspan(i * dst_size, dst_size), src.subspan(i * src_size, src_size));
+    }
+
+    return dst;
+}
+
+static void test_rgba_to_bgra() {
+    for (const size_t count : pixel_counts) {
+        const std::vector<u8> src = random_bytes(count * 4);
+        std::vector<u8> dst(count * 4);
+        std::vector<u8> expected(count * 4);
+
+        for (size_t i = 0; i < count; ++i) {
+            expected[i * 4 + 0] = src[i * 4 + 2];
+            expected[i * 4 + 1] = src[i * 4 + 1];
+            expected[i * 4 + 2] = src[i * 4 + 0];
+            expected[i * 4 + 3] = src[i * 4 + 3];
+        }
+
+        convert_rgba_to_bgra(dst, src);
+        check(dst == expected, "convert_rgba_to_bgra");
+        check(run_per_pixel<u8, u8>(convert_rgba_to_bgra, src, 4, 4) == dst,
+              "convert_rgba_to_bgra per pixel");
+
+        // In place, and back.
+        convert_rgba_to_bgra(dst, dst);
+        check(dst == src, "convert_rgba_to_bgra in place");
+    }
+}
+
+static void test_rgb_to_rgba() {
+    for (const size_t count : pixel_counts) {
+        const std::vector<u8> src = random_bytes(count * 3);
+        std::vector<u8> dst(count * 4);
+        std::vector<u8> expected(count * 4);
+
+        for (size_t i = 0; i < count; ++i) {
+            std::copy_n(src.begin() + i * 3, 3, expected.begin() + i * 4);
+            expected[i * 4 + 3] = 255;
+        }
+
+        convert_rgb_to_rgba(dst, src);
+        check(dst == expected, "convert_rgb_to_rgba");
+        check(run_per_pixel<u8, u8>(convert_rgb_to_rgba, src, 3, 4) == dst, "convert_rgb_to_rgba per pixel");
+    }
+}
+
+// Every color with every alpha, in spans of each length.
+static std::vector<u8> all_colors_and_alphas() {
+    std::vector<u8> pixels;
+
+    for (u32 alpha = 0; alpha < 256; ++alpha) {
+        for (u32 color = 0; color < 256; ++color) {
+            pixels.insert(pixels.end(), {static_cast<u8>(color), static_cast<u8>(255 - color),
+                                         static_cast<u8>(color * 7), static_cast<u8>(alpha)});
+        }
+    }
+
+    return pixels;
+}
+
+static void test_premultiply_alpha() {
+    const std::vector<u8> pixels = all_colors_and_alphas();
+
+    for (const size_t count : pixel_counts) {
+        for (size_t start = 0; start + count <= pixels.size() / 4; start += std::max<size_t>(count, 1) * 61) {
+            const std::span<const u8> src{pixels.data() + start * 4, count * 4};
+            std::vector<u8> dst(count * 4);
+            std::vector<u8> expected(count * 4);
+
+            // Colors times alpha / 255, rounded to nearest. There are no ties, as 255 is odd.
+            for (size_t i = 0; i < count * 4; ++i) {
+                const u32 alpha = src[i / 4 * 4 + 3];
+                expected[i]     = i % 4 == 3 ? src[i] : static_cast<u8>((src[i] * alpha * 2 + 255) / 510);
+            }
+
+            premultiply_alpha(dst, src);
+            check(dst == expected, "premultiply_alpha");
+            check(run_per_pixel<u8, u8>(premultiply_alpha, src, 4, 4) == dst, "premultiply_alpha per pixel");
+
+            std::vector<u8> in_place{src.begin(), src.end()};
+            premultiply_alpha(in_place, in_place);
+            check(in_place == dst, "premultiply_alpha in place");
+        }
+    }
+}
+
+static void test_unpremultiply_alpha() {
+    const std::vector<u8> pixels = all_colors_and_alphas();
+
+    for (const size_t count : pixel_counts) {
+        for (size_t start = 0; start + count <= pixels.size() / 4; start += std::max<size_t>(count, 1) * 61) {
+            const std::span<const u8> src{pixels.data() + start * 4, count * 4};
+            std::vector<u8> dst(count * 4);
+            std::vector<u8> expected(count * 4);
+
+            // Colors times 255 / alpha, rounded to nearest, with colors above alpha clamped to it. Fully
+            // transparent pixels are transparent black.
+            for (size_t i = 0; i < count * 4; ++i) {
+                const u32 alpha = src[i / 4 * 4 + 3];
+                const u32 color = std::min<u32>(src[i], alpha);
+
+                if (i % 4 == 3) {
+                    expected[i] = static_cast<u8>(alpha);
+                } else {
+                    expected[i] = alpha == 0 ? 0 : static_cast<u8>((color * 255 * 2 + alpha) / (alpha * 2));
+                }
+            }
+
+            unpremultiply_alpha(dst, src);
+            check(dst == expected, "unpremultiply_alpha");
+            check(run_per_pixel<u8, u8>(unpremultiply_alpha, src, 4, 4) == dst,
+                  "unpremultiply_alpha per pixel");
+        }
+    }
+
+    // Premultiplying and unpremultiplying opaque pixels gives them back.
+    for (const size_t count : pixel_counts) {
+        std::vector<u8> src = random_bytes(count * 4);
+
+        for (size_t i = 0; i < count; ++i) {
+            src[i * 4 + 3] = 255;
+        }
+
+        std::vector<u8> dst(count * 4);
+        premultiply_alpha(dst, src);
+        unpremultiply_alpha(dst, dst);
+        check(dst == src, "premultiply_alpha and unpremultiply_alpha of opaque pixels");
+    }
+}
+
+static void test_u8_to_f32() {
+    std::vector<u8> all(256);
+    std::ranges::generate(all, [value = 0]() mutable { return static_cast<u8>(value++); });
+
+    for (const size_t count : pixel_counts) {
+        const std::vector<u8> src = count <= 64 ? random_bytes(count * 4) : all;
+        std::vector<f32> dst(src.size());
+
+        convert_u8_to_f32(dst, src);
+
+        // Within an ulp of the exact value, and the same bits as the scalar path.
+        for (size_t i = 0; i < src.size(); ++i) {
+            const f32 exact = static_cast<f32>(src[i]) / 255.0f;
+            check(std::abs(dst[i] - exact) <= std::numeric_limits<f32>::epsilon() * exact,
+                  "convert_u8_to_f32");
+        }
+
+        // Compared as bits, so -0 and 0 differ.
+        const std::vector<f32> per_channel = run_per_pixel<f32, u8>(convert_u8_to_f32, src, 1, 1);
+        check(std::ranges::equal(per_channel, dst,
+                                 [](f32 a, f32 b) { return std::bit_cast<u32>(a) == std::bit_cast<u32>(b); }),
+              "convert_u8_to_f32 per channel");
+
+        // Back to the same bytes.
+        std::vector<u8> round_trip(src.size());
+        convert_f32_to_u8(round_trip, dst);
+        check(round_trip == src, "convert_u8_to_f32 and convert_f32_to_u8");
+    }
+}
+
+static void test_f32_to_u8() {
+    constexpr f32 infinity = std::numeric_limits<f32>::infinity();
+    constexpr f32 nan      = std::numeric_limits<f32>::quiet_NaN();
+
+    // Values out of range, and values just below and above each rounding boundary.
+    std::vector<f32> values{0.0f, -0.0f, 1.0f, -1.0f, 2.0f, infinity, -infinity, nan, -nan, 1e-30f, 1e30f};
+
+    for (u32 i = 0; i < 255; ++i) {
+        const f32 boundary = (static_cast<f32>(i) + 0.5f) / 255.0f;
+        values.insert(values.end(), {std::nextafter(boundary, 0.0f), std::nextafter(boundary, 1.0f)});
+    }
+
+    std::uniform_real_distribution<f32> distribution{-0.25f, 1.25f};
+
+    for (size_t i = 0; i < 4096; ++i) {
+        values.push_back(distribution(random_engine));
+    }
+
+    for (const size_t count : pixel_counts) {
+        const size_t step = std::max<size_t>(count, 1) * 4 * 7;
+
+        for (size_t start = 0; start + count * 4 <= values.size(); start += step) {
+            const std::span<const f32> src{values.data() + start, count * 4};
+            std::vector<u8> dst(src.size());
+            std::vector<u8> expected(src.size());
+
+            // Clamped to [0, 1], with NaN as 0, and rounded to nearest in float like the library, so values a
+            // rounding away from a boundary go the same way.
+            for (size_t i = 0; i < src.size(); ++i) {
+                const f32 value = std::isnan(src[i]) ? 0.0f : std::clamp(src[i], 0.0f, 1.0f);
+                expected[i]     = static_cast<u8>(std::floor(value * 255.0f + 0.5f));
+            }
+
+            convert_f32_to_u8(dst, src);
+            check(dst == expected, "convert_f32_to_u8");
+            check(run_per_pixel<u8, f32>(convert_f32_to_u8, src, 1, 1) == dst,
+                  "convert_f32_to_u8 per channel");
+        }
+    }
+}
+
+int main() {
+    if (!vlk::test::is_simd_supported()) {
+        return vlk::test::skipped;
+    }
+
+    test_rgba_to_bgra();
+    test_rgb_to_rgba();
+    test_premultiply_alpha();
+    test_unpremultiply_alpha();
+    test_u8_to_f32();
+    test_f32_to_u8();
+
+    return vlk::test::exit_code();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdio>
+#include <string_view>
+#include <source_location>
+
+#include "vlk.types.hpp"
+
+#if defined(VLK_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+ * A minimal test harness. Tests are programs that check conditions with check() and return exit_code() from
+ * main(), which ctest runs once per SIMD level the library is built for.
+ */
+namespace vlk::test {
+    inline size_t failure_count = 0;
+
+    // Prints a failure with where it happened if condition is false. Returns condition.
+    inline bool check(bool condition, std::string_view what,
+                      std::source_location location = std::source_location::current()) {
+        if (!condition) {
+            std::printf("%s:%u: FAILED: %.*s\n", location.file_name(), static_cast<unsigned>(location.line()),
+                        static_cast<int>(what.size()), what.data());
+            ++failure_count;
+        }
+
+        return condition;
+    }
+
+    // Whether the CPU has the SIMD instruction sets the test was built for.
+    inline bool is_simd_supported() {
+#if defined(VLK_AVX2) && defined(_MSC_VER)
+        std::array<int, 4> registers{};
+        __cpuidex(registers.data(), 7, 0);
+        return (registers[1] & 1 << 5) != 0;
+#elif defined(VLK_AVX2)
+        return __builtin_cpu_supports("avx2");
+#else
+        return true;
+#endif
+    }
+
+    // Tells ctest to skip the test, see SKIP_RETURN_CODE in CMakeLists.txt.
+    inline constexpr int skipped = 77;
+
+    inline int exit_code() {
+        if (failure_count != 0) {
+            std::printf("%zu checks failed.\n", failure_count);
+            return 1;
+        }
+
+        return 0;
+    }
+}  // namespace vlk::test
@@ -1,6 +1,8 @@
 #include "vlk.gfx.hpp"
 
 #include <algorithm>
+#include <utility>
+#include <cstring>
 
 using namespace vlk;
 
@@ -36,303 +38,342 @@ vertex vertex::lerp(const vertex &other, f32 amount) const {
     return result;
 }
 
-line_stepper::line_stepper(line line, calc_steps_based_on line_type) : m_i{0} {
-    VLK_ASSERT_FAST(line.start.count == line.end.count, "Attribute counts must match.");
+vec2i raster::framebuffer_size(const optional_ref<color_buffer> &color_buf,
+                               const optional_ref<depth_buffer> &depth_buf) {
+    if (color_buf) {
+        return {static_cast<i32>(color_buf->get().width()), static_cast<i32>(color_buf->get().height())};
+    } else {
+        return {static_cast<i32>(depth_buf->get().width()), static_cast<i32>(depth_buf->get().height())};
+    }
+}
 
-    line.start.pos.x() = std::round(line.start.pos.x());
-    line.start.pos.y() = std::round(line.start.pos.y());
-    line.end.pos.x()   = std::round(line.end.pos.x());
-    line.end.pos.y()   = std::round(line.end.pos.y());
+raster::polygon raster::clip(const std::array<vertex, 3> &vertices, u32 planes, const vec2f &guard_band) {
+    // Signed distance to a clip plane, positive on the inside.
+    auto distance = [&](u32 plane, const vec4f &p) {
+        switch (plane) {
+            case 0: return p.x() + guard_band.x() * p.w();
+            case 1: return guard_band.x() * p.w() - p.x();
+            case 2: return p.y() + guard_band.y() * p.w();
+            case 3: return guard_band.y() * p.w() - p.y();
+            case 4: return p.z() + p.w();
+            case 5: return p.w() - p.z();
+        }
+        std::unreachable();
+    };
 
-    m_current = line.start;
+    // Sutherland-Hodgman, alternating between two polygons.
+    std::array<polygon, 2> polygons;
+    polygons[0].vertices[0] = vertices[0];
+    polygons[0].vertices[1] = vertices[1];
+    polygons[0].vertices[2] = vertices[2];
+    polygons[0].count       = 3;
 
-    const vec4f diff = line.end.pos - line.start.pos;
+    u32 curr = 0;
 
-    // Calculate steps i.e. number of increments.
-    switch (line_type) {
-        case calc_steps_based_on::largest_diff:
-            m_steps = static_cast<i32>(std::max(std::abs(diff.x()), std::abs(diff.y())));
-            break;
-        case calc_steps_based_on::x_diff: m_steps = static_cast<i32>(std::abs(diff.x())); break;
-        case calc_steps_based_on::y_diff: m_steps = static_cast<i32>(std::abs(diff.y())); break;
-        default: std::unreachable();
-    }
+    // Near and far first, so the guard band planes only see positions in front of the camera.
+    for (u32 plane : {4, 5, 0, 1, 2, 3}) {
+        if ((planes & (1u << plane)) == 0) {
+            continue;
+        }
 
-    if (m_steps == 0) {
-        return;
-    }
+        const polygon &in = polygons[curr];
+        polygon &out      = polygons[curr ^ 1];
+        out.count         = 0;
 
-    // Calculate how much to increment at each step.
+        for (u32 i = 0; i < in.count; ++i) {
+            const vertex &curr_vertex = in.vertices[i];
+            const vertex &prev_vertex = in.vertices[(i + in.count - 1) % in.count];
 
-    m_increment.pos   = diff / static_cast<f32>(m_steps);
-    m_increment.count = m_current.count;
+            const f32 curr_distance = distance(plane, curr_vertex.pos);
+            const f32 prev_distance = distance(plane, prev_vertex.pos);
 
-    for (u32 i = 0; i < line.start.count; ++i) {
-        VLK_ASSERT_FAST(line.start[i].size == line.end[i].size, "attrib counts must match.");
+            if ((curr_distance >= 0.0f) != (prev_distance >= 0.0f)) {
+                out.vertices[out.count++] =
+                    prev_vertex.lerp(curr_vertex, prev_distance / (prev_distance - curr_distance));
+            }
+            if (curr_distance >= 0.0f) {
+                out.vertices[out.count++] = curr_vertex;
+            }
+        }
 
-        m_increment[i].size = m_current[i].size;
+        curr ^= 1;
 
-        for (u32 j = 0; j < m_current[i].size; ++j) {
-            m_increment[i][j] = (line.end[i][j] - line.start[i][j]) / static_cast<f32>(m_steps);
+        if (out.count < 3) {
+            return {};
         }
     }
+
+    return polygons[curr];
 }
 
-bool line_stepper::step() {
-    if (m_i == m_steps) {
-        return false;
-    }
+vec4f raster::setup_position(vec4f pos, vec2i framebuffer_size) {
+    VLK_ASSERT_FAST(pos.w() != 0, "W can't be 0. Make sure to clip triangle before calling this function.");
 
-    m_i++;
+    // W division (homogeneous clip space -> NDC space).
+    pos.x() /= pos.w();
+    pos.y() /= pos.w();
+    pos.z() /= pos.w();
 
-    m_current.pos += m_increment.pos;
+    // Viewport transformation.
+    // Convert [-1, 1] to [0, framebuffer size], pixel centers are at +0.5.
+    // Snap to the rasterizer's sub-pixel grid.
+    auto viewport = [](f32 ndc, i32 size) {
+        return std::round((ndc + 1.0f) / 2.0f * static_cast<f32>(size) * subpixel_scale) / subpixel_scale;
+    };
 
-    for (u32 i = 0; i < m_current.count; ++i) {
-        m_current[i] += m_increment[i];
-    }
+    pos.x() = viewport(pos.x(), framebuffer_size.x());
+    pos.y() = viewport(pos.y(), framebuffer_size.y());
 
-    return true;
+    return pos;
+}
+
+void raster::setup_vertex(vertex &vertex, vec2i framebuffer_size) {
+    vertex.pos = setup_position(vertex.pos, framebuffer_size);
 }
 
-color_rgba vlk::default_color_blend(const color_rgba &old_color, const color_rgba &new_color) {
-    vec4f ol = old_color;
-    vec4f ne = new_color;
+std::array<vertex, 3> raster::setup(std::array<vertex, 3> vertices, vec2i framebuffer_size) {
+    for (auto &vertex : vertices) {
+        setup_vertex(vertex, framebuffer_size);
+    }
 
-    ol.a() /= 255;
-    ne.a() /= 255;
+    return vertices;
+}
 
-    f32 a = ne.a() + ol.a() * (1.0f - ne.a());
+rect<i32> raster::tile_bins::tile_rect(size_t tile, vec2i framebuffer_size) const {
+    constexpr i32 tile_size = VLK_TILE_SIZE;
 
-    return {ne.rgb() * ne.a() + ol.rgb() * ol.a() * (1.0f - ne.a()) / a, a * 255.0f};
+    const i32 tile_x = static_cast<i32>(tile) % tile_count.x();
+    const i32 tile_y = static_cast<i32>(tile) / tile_count.x();
+
+    return {
+        {tile_x * tile_size, tile_y * tile_size},
+        {std::min((tile_x + 1) * tile_size, framebuffer_size.x()) - 1,
+         std::min((tile_y + 1) * tile_size, framebuffer_size.y()) - 1}
+    };
 }
 
-enum class component {
-    x = 0,
-    y = 1,
-    z = 2
-};
+raster::tile_bins raster::bin_triangles(std::span<const binned_triangle> triangles, vec2i framebuffer_size) {
+    constexpr i32 tile_size = VLK_TILE_SIZE;
 
-static std::vector<vertex> triangle_clip_component(const std::vector<vertex> &vertices, component component) {
-    auto clip = [&](const std::vector<vertex> &vertices, f32 sign) {
-        std::vector<vertex> result;
-        result.reserve(vertices.size());
+    const vec2i tile_count{(framebuffer_size.x() + tile_size - 1) / tile_size,
+                           (framebuffer_size.y() + tile_size - 1) / tile_size};
 
-        for (size_t i = 0; i < vertices.size(); ++i) {
-            const vertex &curr_vertex = vertices[i];
-            const vertex &prev_vertex = vertices[(i - 1 + vertices.size()) % vertices.size()];
+    const size_t count = static_cast<size_t>(tile_count.x() * tile_count.y());
 
-            f32 curr_component = sign * curr_vertex.pos[static_cast<i32>(component)];
-            f32 prev_component = sign * prev_vertex.pos[static_cast<i32>(component)];
+    tile_bins tiles{.tile_count = tile_count, .bins = std::vector<std::vector<u32>>(count)};
 
-            bool curr_is_inside = curr_component <= curr_vertex.pos.w();
-            bool prev_is_inside = prev_component <= prev_vertex.pos.w();
+    for (u32 i = 0; i < triangles.size(); ++i) {
+        const auto &v = triangles[i].vertices;
 
-            if (curr_is_inside != prev_is_inside) {
-                float lerp_amount =
-                    (prev_vertex.pos.w() - prev_component) /
-                    ((prev_vertex.pos.w() - prev_component) - (curr_vertex.pos.w() - curr_component));
+        // Same bounding box as fill_triangle().
+        const vec2i p0 = fixed_pos(v[0].pos);
+        const vec2i p1 = fixed_pos(v[1].pos);
+        const vec2i p2 = fixed_pos(v[2].pos);
 
-                result.emplace_back(prev_vertex.lerp(curr_vertex, lerp_amount));
-            }
+        const i32 min_x = std::min({p0.x(), p1.x(), p2.x()}) >> subpixel_bits;
+        const i32 max_x = std::max({p0.x(), p1.x(), p2.x()}) >> subpixel_bits;
+        const i32 min_y = std::min({p0.y(), p1.y(), p2.y()}) >> subpixel_bits;
+        const i32 max_y = std::max({p0.y(), p1.y(), p2.y()}) >> subpixel_bits;
 
-            if (curr_is_inside) {
-                result.emplace_back(curr_vertex);
+        const i32 start_tile_x = std::clamp(min_x, 0, framebuffer_size.x() - 1) / tile_size;
+        const i32 end_tile_x   = std::clamp(max_x, 0, framebuffer_size.x() - 1) / tile_size;
+        const i32 start_tile_y = std::clamp(min_y, 0, framebuffer_size.y() - 1) / tile_size;
+        const i32 end_tile_y   = std::clamp(max_y, 0, framebuffer_size.y() - 1) / tile_size;
+
+        for (i32 tile_y = start_tile_y; tile_y <= end_tile_y; ++tile_y) {
+            for (i32 tile_x = start_tile_x; tile_x <= end_tile_x; ++tile_x) {
+                tiles.bins[tile_y * tiles.tile_count.x() + tile_x].push_back(i);
             }
         }
+    }
 
-        return result;
-    };
+    return tiles;
+}
 
-    std::vector<vertex> result = clip(vertices, 1.0f);
-    if (result.empty()) {
-        return result;
-    }
-    return clip(result, -1.0f);
+void vlk::render_triangle(const render_triangle_params &params) {
+    render_triangle<pixel_shader_func, color_blend_func>(params);
 }
 
-static std::vector<vertex> triangle_clip(const std::array<vertex, 3> &vertices) {
-    std::vector<vertex> result = triangle_clip_component({vertices.begin(), vertices.end()}, component::x);
+void vlk::render_triangles(const render_triangles_params &params) {
+    render_triangles<pixel_shader_func, color_blend_func>(params);
+}
 
-    if (result.empty()) {
-        return result;
-    }
+void vlk::render_indexed(const render_indexed_params &params) {
+    render_indexed<pixel_shader_func, color_blend_func>(params);
+}
 
-    result = triangle_clip_component(result, component::y);
-    if (result.empty()) {
-        return result;
-    }
+#if defined(VLK_SSE2)
+static bool is_all_set(__m128i mask) { return _mm_movemask_epi8(mask) == 0xffff; }
 
-    result = triangle_clip_component(result, component::z);
-    return result;
-}
+// Alpha blends 4 pixels the same way blend() does. Only handles pixels that are all opaque or all fully
+// transparent, returns false if the scalar path is needed.
+static bool blend_alpha_4(__m128i &old_colors, __m128i new_colors) {
+    const __m128i zero       = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32(static_cast<i32>(0xff000000));
+    const __m128i new_alpha  = _mm_and_si128(new_colors, alpha_mask);
+    const __m128i old_alpha  = _mm_and_si128(old_colors, alpha_mask);
 
-static void raster_triangle_scanline(const render_triangle_params &params, line a, line b) {
-    if (a.start.pos.x() > b.start.pos.x()) {
-        std::swap(a, b);
+    if (is_all_set(_mm_cmpeq_epi32(new_alpha, alpha_mask))) {
+        old_colors = new_colors;
+        return true;
     }
 
-    line_stepper line_a{a, line_stepper::calc_steps_based_on::y_diff};
-    line_stepper line_b{b, line_stepper::calc_steps_based_on::y_diff};
+    const __m128i is_new_clear = _mm_cmpeq_epi32(new_alpha, zero);
 
-    do {
-        VLK_ASSERT_FAST(line_a.vertex().pos.y() == line_b.vertex().pos.y(),
-                        "Y coordinate must the be same for both lines.");
+    if (is_all_set(is_new_clear)) {
+        return true;
+    }
 
-        line_stepper line_x{
-            line{line_a.vertex(), line_b.vertex()},
-            line_stepper::calc_steps_based_on::x_diff
-        };
+    const bool is_old_opaque = is_all_set(_mm_cmpeq_epi32(old_alpha, alpha_mask));
+    const bool is_old_clear  = is_all_set(_mm_cmpeq_epi32(old_alpha, zero));
 
-        do {
-            i32 x = static_cast<i32>(line_x.vertex().pos.x());
-            i32 y = static_cast<i32>(line_x.vertex().pos.y());
+    if (!is_old_opaque && !is_old_clear) {
+        return false;
+    }
 
-            if (params.depth_buf) {
-                VLK_ASSERT_FAST(x >= 0 && x < params.depth_buf->get().width() && y >= 0 &&
-                                    y < params.depth_buf->get().height(),
-                                "Outside bounds.");
+    // Two pixels of 16-bit channels at a time.
+    auto blend_2 = [&](__m128i old16, __m128i new16) {
+        const __m128i alpha16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(new16, _MM_SHUFFLE(3, 3, 3, 3)),
+                                                    _MM_SHUFFLE(3, 3, 3, 3));
 
-                f32 &depth_buf_z = params.depth_buf->get().at(x, y);
-                f32 current_z    = line_x.vertex().pos.z();
+        if (is_old_opaque) {
+            const __m128i inv_alpha16 = _mm_sub_epi16(_mm_set1_epi16(255), alpha16);
+            return div_255_epu16(
+                _mm_add_epi16(_mm_mullo_epi16(new16, alpha16), _mm_mullo_epi16(old16, inv_alpha16)));
+        }
 
-                if (current_z < depth_buf_z) {
-                    depth_buf_z = current_z;
-                }
-                // If the pixel is invisible, do not run the pixel shader.
-                else {
-                    continue;
-                }
-            }
+        // Nothing of the old color is left, the alpha of the result is the new alpha.
+        const __m128i alpha_lanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+        const __m128i factor16    = _mm_or_si128(_mm_andnot_si128(alpha_lanes, alpha16),
+                                                 _mm_and_si128(alpha_lanes, _mm_set1_epi16(255)));
+        return div_255_epu16(_mm_mullo_epi16(new16, factor16));
+    };
 
-            if (params.color_buf) {
-                VLK_ASSERT_FAST(x >= 0 && x < params.color_buf->get().width() && y >= 0 &&
-                                    y < params.color_buf->get().height(),
-                                "Outside bounds.");
+    const __m128i lo = blend_2(_mm_unpacklo_epi8(old_colors, zero), _mm_unpacklo_epi8(new_colors, zero));
+    const __m128i hi = blend_2(_mm_unpackhi_epi8(old_colors, zero), _mm_unpackhi_epi8(new_colors, zero));
 
-                color_rgba &dest = params.color_buf->get().at(x, y);
+    __m128i result = _mm_packus_epi16(lo, hi);
 
-                color_rgba old_color = dest;
-                color_rgba new_color = params.pixel_shader(line_x.vertex());
+    if (is_old_opaque) {
+        result = _mm_or_si128(result, alpha_mask);
+    } else {
+        // Fully transparent new colors leave the old ones as they were.
+        result =
+            _mm_or_si128(_mm_and_si128(is_new_clear, old_colors), _mm_andnot_si128(is_new_clear, result));
+    }
 
-                dest = params.color_blend(old_color, new_color);
-            }
-        } while (line_x.step());
-    } while (line_a.step() && line_b.step());
+    old_colors = result;
+    return true;
 }
 
-// NOTE: The entire triangle MUST be visible.
-static void fill_triangle(const render_triangle_params &params) {
-    // Make a modifiable copy of the vertices.
-    std::array<vertex, 3> vertices = params.vertices;
+static __m128i blend_premultiplied_4(__m128i old_colors, __m128i new_colors) {
+    const __m128i zero = _mm_setzero_si128();
 
-    // W division (homogeneous clip space -> NDC space).
-    for (auto &vertex : vertices) {
-        auto &pos = vertex.pos;
+    // 255 - alpha of each new color in all of its 16-bit lanes.
+    auto inv_alpha_2 = [](__m128i new16) {
+        const __m128i alpha16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(new16, _MM_SHUFFLE(3, 3, 3, 3)),
+                                                    _MM_SHUFFLE(3, 3, 3, 3));
+        return _mm_sub_epi16(_mm_set1_epi16(255), alpha16);
+    };
 
-        VLK_ASSERT_FAST(pos.w() != 0,
-                        "W can't be 0. Make sure to clip triangle before calling this function.");
+    const __m128i lo = div_255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(old_colors, zero),
+                                                     inv_alpha_2(_mm_unpacklo_epi8(new_colors, zero))));
+    const __m128i hi = div_255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(old_colors, zero),
+                                                     inv_alpha_2(_mm_unpackhi_epi8(new_colors, zero))));
 
-        pos.x() /= pos.w();
-        pos.y() /= pos.w();
-        pos.z() /= pos.w();
-    }
+    return _mm_adds_epu8(new_colors, _mm_packus_epi16(lo, hi));
+}
+
+static __m128i blend_multiply_4(__m128i old_colors, __m128i new_colors) {
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i old_lo = _mm_unpacklo_epi8(old_colors, zero);
+    const __m128i old_hi = _mm_unpackhi_epi8(old_colors, zero);
+    const __m128i new_lo = _mm_unpacklo_epi8(new_colors, zero);
+    const __m128i new_hi = _mm_unpackhi_epi8(new_colors, zero);
 
-    const auto framebuffer_size = [&]() -> vec2i {
-        if (params.color_buf) {
-            return {static_cast<i32>(params.color_buf->get().width()),
-                    static_cast<i32>(params.color_buf->get().height())};
+    return _mm_packus_epi16(div_255_epu16(_mm_mullo_epi16(old_lo, new_lo)),
+                            div_255_epu16(_mm_mullo_epi16(old_hi, new_hi)));
+}
+#endif
+
+// Blends count colors into pixels. colors advances by color_step per pixel, 0 blends a single color.
+static void blend_run(blend_mode mode, color_rgba *pixels, const color_rgba *colors, size_t color_step,
+                      size_t count) {
+    if (mode == blend_mode::replace) {
+        if (color_step != 0) {
+            std::copy_n(colors, count, pixels);
         } else {
-            return {static_cast<i32>(params.depth_buf->get().width()),
-                    static_cast<i32>(params.depth_buf->get().height())};
+            std::fill_n(pixels, count, *colors);
         }
-    }();
-
-    // Viewport transformation.
-    // Convert [-1, 1] to framebuffer size.
-    // Round to nearest pixel pos.
-    for (auto &vertex : vertices) {
-        auto &pos = vertex.pos;
-
-        pos.x() = std::round((pos.x() + 1.0f) / 2.0f * (static_cast<f32>(framebuffer_size.x()) - 1.0f));
-        pos.y() = std::round((pos.y() + 1.0f) / 2.0f * (static_cast<f32>(framebuffer_size.y()) - 1.0f));
+        return;
     }
 
-    // Position aliases.
-    vec4f &p0 = vertices[0].pos;
-    vec4f &p1 = vertices[1].pos;
-    vec4f &p2 = vertices[2].pos;
-
-    // Sort vertices by Y.
-    if (p0.y() > p1.y()) {
-        std::swap(vertices[0], vertices[1]);
-    }
-    if (p0.y() > p2.y()) {
-        std::swap(vertices[0], vertices[2]);
-    }
-    if (p1.y() > p2.y()) {
-        std::swap(vertices[1], vertices[2]);
+    // A single opaque color covers the pixels, a fully transparent one leaves them as they are. Premultiplied
+    // colors with no alpha can still add to the pixels.
+    if ((mode == blend_mode::alpha || mode == blend_mode::premultiplied) && color_step == 0) {
+        if (colors->a() == 255) {
+            std::fill_n(pixels, count, *colors);
+            return;
+        }
+        if (colors->a() == 0 && mode == blend_mode::alpha) {
+            return;
+        }
     }
 
-    // Check if the top of the triangle is flat.
-    if (p0.y() == p1.y()) {
-        raster_triangle_scanline(params, line{vertices[0], vertices[2]}, line{vertices[1], vertices[2]});
-    }
-    // Check if the bottom is flat.
-    else if (p1.y() == p2.y()) {
-        raster_triangle_scanline(params, line{vertices[0], vertices[1]}, line{vertices[0], vertices[2]});
-    }
-    // Else split into two smaller triangles.
-    else {
-        float lerp_amount = (p1.y() - p0.y()) / (p2.y() - p0.y());
-        vertex vertex_3   = vertices[0].lerp(vertices[2], lerp_amount);
+    size_t i = 0;
 
-        // Top (flat bottom).
-        raster_triangle_scanline(params, line{vertices[0], vertices[1]}, line{vertices[0], vertex_3});
+#if defined(VLK_SSE2)
+    i32 color_bits = 0;
 
-        // Bottom (flat top).
-        raster_triangle_scanline(params, line{vertices[1], vertices[2]}, line{vertex_3, vertices[2]});
+    if (color_step == 0) {
+        std::memcpy(&color_bits, colors, sizeof(color_bits));
     }
-}
 
-void vlk::render_triangle(const render_triangle_params &params) {
-    VLK_ASSERT_FAST(params.color_buf || params.depth_buf,
-                    "Either a color buffer, depth buffer or both must be present.");
-
-    auto is_point_visible = [](const vec4f &p) {
-        return p.x() >= -p.w() && p.x() <= p.w() && p.y() >= -p.w() && p.y() <= p.w() && p.z() >= -p.w() &&
-               p.z() <= p.w();
-    };
-
-    // Position aliases.
-    const vec4f &p0 = params.vertices[0].pos;
-    const vec4f &p1 = params.vertices[1].pos;
-    const vec4f &p2 = params.vertices[2].pos;
-
-    bool is_p0_visible = is_point_visible(p0);
-    bool is_p1_visible = is_point_visible(p1);
-    bool is_p2_visible = is_point_visible(p2);
+    for (; i + 4 <= count; i += 4) {
+        __m128i *dst             = reinterpret_cast<__m128i *>(pixels + i);
+        __m128i old_colors       = _mm_loadu_si128(dst);
+        const __m128i new_colors = color_step != 0
+                                       ? _mm_loadu_si128(reinterpret_cast<const __m128i *>(colors + i))
+                                       : _mm_set1_epi32(color_bits);
+
+        switch (mode) {
+            case blend_mode::alpha:
+                if (!blend_alpha_4(old_colors, new_colors)) {
+                    for (size_t j = i; j < i + 4; ++j) {
+                        pixels[j] = blend(mode, pixels[j], colors[j * color_step]);
+                    }
+                    continue;
+                }
+                break;
+            case blend_mode::premultiplied:
+                old_colors = blend_premultiplied_4(old_colors, new_colors);
+                break;
+            case blend_mode::add:
+                old_colors = _mm_adds_epu8(old_colors, new_colors);
+                break;
+            case blend_mode::multiply:
+                old_colors = blend_multiply_4(old_colors, new_colors);
+                break;
+            default:
+                std::unreachable();
+        }
 
-    // If all points are visible, draw triangle.
-    if (is_p0_visible && is_p1_visible && is_p2_visible) {
-        fill_triangle(params);
-        return;
-    }
-    // If no vertices are visible, discard triangle.
-    if (!is_p0_visible && !is_p1_visible && !is_p2_visible) {
-        return;
+        _mm_storeu_si128(dst, old_colors);
     }
+#endif
 
-    // Else clip triangle.
-
-    std::vector<vertex> clipped_vertices = triangle_clip(params.vertices);
-    VLK_ASSERT_FAST(clipped_vertices.size() >= 3, "Can't render a polygon with less than 3 vertices.");
+    for (; i < count; ++i) {
+        pixels[i] = blend(mode, pixels[i], colors[i * color_step]);
+    }
+}
 
-    for (size_t i = 1; i < clipped_vertices.size() - 1; ++i) {
-        render_triangle_params new_params = params;
-        new_params.vertices = {clipped_vertices[0], clipped_vertices[i], clipped_vertices[i + 1]};
+void vlk::blend_span(blend_mode mode, std::span<color_rgba> pixels, std::span<const color_rgba> colors) {
+    VLK_ASSERT(pixels.size() == colors.size(), "Pixel and color counts must match.");
+    blend_run(mode, pixels.data(), colors.data(), 1, pixels.size());
+}
 
-        fill_triangle(new_params);
-    }
+void vlk::blend_span(blend_mode mode, std::span<color_rgba> pixels, const color_rgba &color) {
+    blend_run(mode, pixels.data(), &color, 0, pixels.size());
 }
 
 static bool clip_rect(rect<size_t> &r, size_t width, size_t height) {
@@ -362,33 +403,388 @@ void vlk::render_rect_color(const render_rect_color_params &params) {
         return;
     }
 
-    for (size_t x = dst.start.x(); x <= dst.end.x(); ++x) {
-        for (size_t y = dst.start.y(); y <= dst.end.y(); ++y) {
-            auto &pixel = params.color_buf.at(x, y);
-            pixel       = vlk::default_color_blend(pixel, params.color);
-        }
+    for (size_t y = dst.start.y(); y <= dst.end.y(); ++y) {
+        params.color_buf.for_each_run(y, dst.start.x(), dst.end.x() + 1,
+                                      [&](size_t, std::span<color_rgba> pixels) {
+                                          blend_span(params.blend, pixels, params.color);
+                                      });
+    }
+}
+
+// Blends color into old as if it covered coverage / 255 of the pixel.
+static color_rgba blend_coverage(blend_mode mode, const color_rgba &old_color, const color_rgba &color,
+                                 u32 coverage) {
+    const color_rgba blended = blend(mode, old_color, color);
+
+    color_rgba result;
+
+    for (size_t i = 0; i < 4; ++i) {
+        result[i] = static_cast<u8>(div_255(old_color[i] * (255 - coverage) + blended[i] * coverage));
     }
+
+    return result;
+}
+
+// Coverage in 1/255ths of a pixel whose center is dist_x and dist_y away from the center of a corner's
+// circle, from its signed distance to the circle.
+static u32 corner_coverage(f32 dist_x, f32 dist_y, f32 radius) {
+    const f32 coverage = std::clamp(radius - std::sqrt(dist_x * dist_x + dist_y * dist_y) + 0.5f, 0.0f, 1.0f);
+    return static_cast<u32>(coverage * 255.0f + 0.5f);
 }
 
 void vlk::render_rect_color_rounded(const render_rect_color_rounded_params &params) {
-    render_rect_color({params.dst, params.color, params.color_buf});
+    rect<size_t> dst = params.dst;
+
+    if (dst.start.x() > dst.end.x()) {
+        std::swap(dst.start.x(), dst.end.x());
+    }
+    if (dst.start.y() > dst.end.y()) {
+        std::swap(dst.start.y(), dst.end.y());
+    }
+
+    // Edges of the rect, which covers its end pixels.
+    const f32 left   = static_cast<f32>(dst.start.x());
+    const f32 right  = static_cast<f32>(dst.end.x() + 1);
+    const f32 top    = static_cast<f32>(dst.start.y());
+    const f32 bottom = static_cast<f32>(dst.end.y() + 1);
+    const f32 radius = std::clamp(params.radius, 0.0f, std::min(right - left, bottom - top) / 2);
+
+    const bool is_rounded =
+        radius > 0.0f && (params.top_left || params.top_right || params.bottom_left || params.bottom_right);
+
+    if (!is_rounded) {
+        render_rect_color({params.dst, params.color, params.color_buf, params.blend});
+        return;
+    }
+
+    rect<size_t> clipped = dst;
+
+    if (!clip_rect(clipped, params.color_buf.width(), params.color_buf.height())) {
+        return;
+    }
+
+    for (size_t y = clipped.start.y(); y <= clipped.end.y(); ++y) {
+        const f32 center_y = static_cast<f32>(y) + 0.5f;
+
+        size_t start_x = clipped.start.x();
+        size_t end_x   = clipped.end.x() + 1;
+
+        // Rows through the corners only evaluate the coverage from the edges in to the first fully covered
+        // pixel, the rest of the row is filled as a span.
+        f32 dist_y        = 0.0f;
+        bool is_left_arc  = false;
+        bool is_right_arc = false;
+
+        if (center_y < top + radius) {
+            dist_y       = top + radius - center_y;
+            is_left_arc  = params.top_left;
+            is_right_arc = params.top_right;
+        } else if (center_y > bottom - radius) {
+            dist_y       = center_y - (bottom - radius);
+            is_left_arc  = params.bottom_left;
+            is_right_arc = params.bottom_right;
+        }
+
+        auto blend_pixel = [&](size_t x, u32 coverage) {
+            if (coverage != 0 && x >= clipped.start.x() && x <= clipped.end.x()) {
+                color_rgba &pixel = params.color_buf.at(x, y);
+                pixel             = blend_coverage(params.blend, pixel, params.color, coverage);
+            }
+        };
+
+        if (is_left_arc) {
+            size_t x = dst.start.x();
+
+            for (; static_cast<f32>(x) + 0.5f < left + radius; ++x) {
+                const u32 coverage =
+                    corner_coverage(left + radius - (static_cast<f32>(x) + 0.5f), dist_y, radius);
+
+                if (coverage == 255) {
+                    break;
+                }
+
+                blend_pixel(x, coverage);
+            }
+
+            start_x = std::max(start_x, x);
+        }
+
+        if (is_right_arc) {
+            size_t x = dst.end.x() + 1;
+
+            for (; x > start_x && static_cast<f32>(x) - 0.5f > right - radius; --x) {
+                const u32 coverage =
+                    corner_coverage(static_cast<f32>(x) - 0.5f - (right - radius), dist_y, radius);
+
+                if (coverage == 255) {
+                    break;
+                }
+
+                blend_pixel(x - 1, coverage);
+            }
+
+            end_x = std::min(end_x, x);
+        }
+
+        if (start_x < end_x) {
+            params.color_buf.for_each_run(y, start_x, end_x, [&](size_t, std::span<color_rgba> pixels) {
+                blend_span(params.blend, pixels, params.color);
+            });
+        }
+    }
 }
 
 void vlk::blit_image(const blit_image_params &params) {
     VLK_ASSERT(params.image.channels() == 4, "Image must be RGBA.");
 
+    // The source rectangle excludes its end, clip it to the image and then to the buffer at the destination.
     rect<size_t> src = params.src;
 
-    if (!clip_rect(src, std::min(params.image.width(), params.color_buf.width()),
-                   std::min(params.image.height(), params.color_buf.height()))) {
+    if (src.start.x() > src.end.x()) {
+        std::swap(src.start.x(), src.end.x());
+    }
+    if (src.start.y() > src.end.y()) {
+        std::swap(src.start.y(), src.end.y());
+    }
+
+    src.end.x() = std::min(src.end.x(), params.image.width());
+    src.end.y() = std::min(src.end.y(), params.image.height());
+
+    if (src.start.x() >= src.end.x() || src.start.y() >= src.end.y() ||
+        params.dst.x() >= params.color_buf.width() || params.dst.y() >= params.color_buf.height()) {
+        return;
+    }
+
+    const size_t width  = std::min(src.end.x() - src.start.x(), params.color_buf.width() - params.dst.x());
+    const size_t height = std::min(src.end.y() - src.start.y(), params.color_buf.height() - params.dst.y());
+
+    for (size_t y = 0; y < height; ++y) {
+        // The image is RGBA, so its rows are runs of colors already.
+        const color_rgba *src_row =
+            reinterpret_cast<const color_rgba *>(&*params.image.at(src.start.x(), src.start.y() + y));
+
+        params.color_buf.for_each_run(params.dst.y() + y, params.dst.x(), params.dst.x() + width,
+                                      [&](size_t x, std::span<color_rgba> pixels) {
+                                          const color_rgba *colors = src_row + (x - params.dst.x());
+                                          blend_span(params.blend, pixels, {colors, pixels.size()});
+                                      });
+    }
+}
+
+// Copies row y of buffer into pixels.
+static void read_row(const color_buffer &buffer, size_t y, color_rgba *pixels) {
+    buffer.for_each_run(y, 0, buffer.width(), [&](size_t x, std::span<const color_rgba> run) {
+        std::copy_n(run.data(), run.size(), pixels + x);
+    });
+}
+
+// Copies pixels into row y of buffer, from start_x on.
+static void write_row(color_buffer &buffer, size_t y, size_t start_x, const color_rgba *pixels,
+                      size_t count) {
+    buffer.for_each_run(y, start_x, start_x + count, [&](size_t x, std::span<color_rgba> run) {
+        std::copy_n(pixels + (x - start_x), run.size(), run.data());
+    });
+}
+
+// Position of the center of dst pixel i, mapped to a source of src_size pixels, in 1/256ths of a pixel
+// relative to the first source pixel center.
+static i64 resample_coord(size_t i, size_t src_size, size_t dst_size) {
+    return static_cast<i64>(((2 * i + 1) * src_size * 256) / (2 * dst_size)) - 128;
+}
+
+// Blends the colors a and b, weight is b's share in 1/256ths.
+static void lerp_row(const color_rgba *a, const color_rgba *b, i32 weight, color_rgba *result, size_t count) {
+    size_t i = 0;
+
+#if defined(VLK_SSE2)
+    const __m128i zero     = _mm_setzero_si128();
+    const __m128i half     = _mm_set1_epi16(128);
+    const __m128i weight_a = _mm_set1_epi16(static_cast<i16>(256 - weight));
+    const __m128i weight_b = _mm_set1_epi16(static_cast<i16>(weight));
+
+    // Sums stay below 2^16 since the weights add up to 256.
+    auto lerp_half = [&](__m128i a16, __m128i b16) {
+        const __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a16, weight_a), _mm_mullo_epi16(b16, weight_b));
+        return _mm_srli_epi16(_mm_add_epi16(sum, half), 8);
+    };
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128i a4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i b4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+
+        const __m128i lo = lerp_half(_mm_unpacklo_epi8(a4, zero), _mm_unpacklo_epi8(b4, zero));
+        const __m128i hi = lerp_half(_mm_unpackhi_epi8(a4, zero), _mm_unpackhi_epi8(b4, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(result + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        for (i32 c = 0; c < 4; ++c) {
+            result[i][c] = static_cast<u8>((a[i][c] * (256 - weight) + b[i][c] * weight + 128) >> 8);
+        }
+    }
+}
+
+void vlk::resample_buffer(const resample_buffer_params &params) {
+    const color_buffer &src = params.src;
+    color_buffer &dst       = params.dst;
+
+    if (src.width() == 0 || src.height() == 0 || dst.width() == 0 || dst.height() == 0) {
         return;
     }
 
-    for (size_t x = 0; x < (src.end.x() - src.start.x()); ++x) {
-        for (size_t y = 0; y < (src.end.y() - src.start.y()); ++y) {
-            auto &dst_pixel = params.color_buf.at(params.dst.x() + x, params.dst.y() + y);
-            auto src_pixel  = image::to_rgba(params.image.at(src.start.x() + x, src.start.y() + y));
-            dst_pixel       = vlk::default_color_blend(dst_pixel, src_pixel);
+    // The part of dst that's drawn to.
+    size_t start_x = 0;
+    size_t start_y = 0;
+    size_t width   = dst.width();
+    size_t height  = dst.height();
+    size_t scale   = 1;
+
+    if (params.filter == resample_filter::integer) {
+        scale   = std::max(std::min(dst.width() / src.width(), dst.height() / src.height()), size_t{1});
+        width   = std::min(src.width() * scale, dst.width());
+        height  = std::min(src.height() * scale, dst.height());
+        start_x = (dst.width() - width) / 2;
+        start_y = (dst.height() - height) / 2;
+    }
+
+    const bool is_bilinear = params.filter == resample_filter::bilinear;
+
+    // Source columns of each column drawn to, and for bilinear filtering the weight of the second one.
+    std::vector<u32> columns(width * (is_bilinear ? 2 : 1));
+    std::vector<u8> weights(is_bilinear ? width : 0);
+
+    const i64 last_column = static_cast<i64>(src.width() - 1);
+
+    for (size_t x = 0; x < width; ++x) {
+        if (params.filter == resample_filter::integer) {
+            columns[x] = static_cast<u32>(x / scale);
+        } else if (!is_bilinear) {
+            columns[x] = static_cast<u32>(((2 * x + 1) * src.width()) / (2 * width));
+        } else {
+            const i64 u = resample_coord(x, src.width(), width);
+
+            columns[x * 2 + 0] = static_cast<u32>(std::clamp(u >> 8, i64{0}, last_column));
+            columns[x * 2 + 1] = static_cast<u32>(std::clamp((u >> 8) + 1, i64{0}, last_column));
+            weights[x]         = static_cast<u8>(u & 255);
+        }
+    }
+
+    // Resamples the row of src into result.
+    auto resample_row = [&](const color_rgba *row, color_rgba *result) {
+        if (!is_bilinear) {
+            for (size_t x = 0; x < width; ++x) {
+                result[x] = row[columns[x]];
+            }
+            return;
+        }
+
+        for (size_t x = 0; x < width; ++x) {
+            const color_rgba a = row[columns[x * 2 + 0]];
+            const color_rgba b = row[columns[x * 2 + 1]];
+            const i32 weight   = weights[x];
+
+            for (i32 c = 0; c < 4; ++c) {
+                result[x][c] = static_cast<u8>((a[c] * (256 - weight) + b[c] * weight + 128) >> 8);
+            }
+        }
+    };
+
+    // Bands of whole tile rows, so no two threads resolve the same cleared tiles of dst.
+    constexpr size_t band_size = color_buffer::tile_size * 4;
+
+    const size_t end_y      = start_y + height;
+    const size_t first_band = start_y / band_size;
+    const size_t band_count = (end_y - 1) / band_size + 1 - first_band;
+
+    auto resample_band = [&](size_t band) {
+        const size_t band_start = std::max((first_band + band) * band_size, start_y);
+        const size_t band_end   = std::min((first_band + band + 1) * band_size, end_y);
+
+        std::vector<color_rgba> src_row(src.width());
+        std::vector<color_rgba> result(width);
+
+        // Rows of src resampled horizontally, the source rows they're of or -1. Upscaling reuses them for
+        // several rows of dst.
+        std::array<std::vector<color_rgba>, 2> rows{std::vector<color_rgba>(width),
+                                                    std::vector<color_rgba>(width)};
+        std::array<i64, 2> row_ys{-1, -1};
+
+        auto resampled_row = [&](i64 y, size_t slot) {
+            if (row_ys[slot] != y) {
+                if (row_ys[slot ^ 1] == y) {
+                    std::swap(rows[0], rows[1]);
+                    std::swap(row_ys[0], row_ys[1]);
+                } else {
+                    read_row(src, static_cast<size_t>(y), src_row.data());
+                    resample_row(src_row.data(), rows[slot].data());
+                    row_ys[slot] = y;
+                }
+            }
+            return rows[slot].data();
+        };
+
+        const i64 last_row = static_cast<i64>(src.height() - 1);
+
+        for (size_t y = band_start; y < band_end; ++y) {
+            const size_t row = y - start_y;
+
+            if (params.filter == resample_filter::integer) {
+                write_row(dst, y, start_x, resampled_row(static_cast<i64>(row / scale), 0), width);
+            } else if (!is_bilinear) {
+                const size_t src_y = ((2 * row + 1) * src.height()) / (2 * height);
+                write_row(dst, y, start_x, resampled_row(static_cast<i64>(src_y), 0), width);
+            } else {
+                const i64 v      = resample_coord(row, src.height(), height);
+                const i32 weight = static_cast<i32>(v & 255);
+
+                const color_rgba *top = resampled_row(std::clamp(v >> 8, i64{0}, last_row), 0);
+
+                if (weight == 0) {
+                    write_row(dst, y, start_x, top, width);
+                    continue;
+                }
+
+                const color_rgba *bottom = resampled_row(std::clamp((v >> 8) + 1, i64{0}, last_row), 1);
+
+                lerp_row(top, bottom, weight, result.data(), width);
+                write_row(dst, y, start_x, result.data(), width);
+            }
+        }
+    };
+
+    if (params.multithreaded) {
+        thread_pool::global().parallel_for(band_count, resample_band);
+    } else {
+        for (size_t band = 0; band < band_count; ++band) {
+            resample_band(band);
+        }
+    }
+}
+
+void depth_buffer::update_bounds() {
+    for (size_t block_y = 0; block_y * block_size < height(); ++block_y) {
+        for (size_t block_x = 0; block_x * block_size < width(); ++block_x) {
+            bounds &bounds = block_bounds(block_x, block_y);
+
+            if (m_tile_cleared[block_y * m_tiles_x + block_x]) {
+                bounds = {m_clear_value, m_clear_value};
+                continue;
+            }
+
+            bounds.min = std::numeric_limits<f32>::infinity();
+            bounds.max = -std::numeric_limits<f32>::infinity();
+
+            const size_t end_x = std::min((block_x + 1) * block_size, width());
+            const size_t end_y = std::min((block_y + 1) * block_size, height());
+
+            for (size_t y = block_y * block_size; y < end_y; ++y) {
+                for (size_t x = block_x * block_size; x < end_x; ++x) {
+                    bounds.min = std::min(bounds.min, m_data[index(x, y)]);
+                    bounds.max = std::max(bounds.max, m_data[index(x, y)]);
+                }
+            }
         }
     }
 }
@@ -419,11 +815,15 @@ std::vector<u8>::const_iterator image::sample(f32 x, f32 y) const {
 }
 
 color_rgb image::to_rgb(std::vector<u8>::const_iterator iter) {
-    return {*(iter + 0), *(iter + 1), *(iter + 2)};
+    color_rgb color;
+    std::memcpy(&color, &*iter, sizeof(color));
+    return color;
 }
 
 color_rgba image::to_rgba(std::vector<u8>::const_iterator iter) {
-    return {*(iter + 0), *(iter + 1), *(iter + 2), *(iter + 3)};
+    color_rgba color;
+    std::memcpy(&color, &*iter, sizeof(color));
+    return color;
 }
 
 image image::flip_vertically(const image &image) {
@@ -442,6 +842,478 @@ image image::flip_vertically(const image &image) {
     return result;
 }
 
+static u16 to_rgb565(const vec3f &color) {
+    const u32 r = static_cast<u32>(std::clamp(color.x(), 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    const u32 g = static_cast<u32>(std::clamp(color.y(), 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    const u32 b = static_cast<u32>(std::clamp(color.z(), 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+
+    return static_cast<u16>(r << 11 | g << 5 | b);
+}
+
+static color_rgba from_rgb565(u32 color) {
+    const u32 r = (color >> 11) & 31;
+    const u32 g = (color >> 5) & 63;
+    const u32 b = color & 31;
+
+    return {r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 255u};
+}
+
+// Color i of a BC1 color block. In BC3 the color block is always in four color mode.
+static color_rgba decode_color(u64 block, i32 i, bool is_four_color) {
+    const u32 c0    = static_cast<u32>(block & 0xffff);
+    const u32 c1    = static_cast<u32>((block >> 16) & 0xffff);
+    const u32 index = static_cast<u32>(block >> (32 + i * 2)) & 3;
+
+    if (index == 0) {
+        return from_rgb565(c0);
+    }
+    if (index == 1) {
+        return from_rgb565(c1);
+    }
+
+    const color_rgba e0 = from_rgb565(c0);
+    const color_rgba e1 = from_rgb565(c1);
+
+    if (is_four_color || c0 > c1) {
+        const u32 w0 = index == 2 ? 2 : 1;
+        const u32 w1 = 3 - w0;
+
+        return {(e0.r() * w0 + e1.r() * w1) / 3, (e0.g() * w0 + e1.g() * w1) / 3,
+                (e0.b() * w0 + e1.b() * w1) / 3, 255u};
+    }
+    if (index == 2) {
+        return {(e0.r() + e1.r()) / 2, (e0.g() + e1.g()) / 2, (e0.b() + e1.b()) / 2, 255};
+    }
+
+    return {0, 0, 0, 0};
+}
+
+// Alpha i of a BC3 alpha block.
+static u8 decode_alpha(u64 block, i32 i) {
+    const u32 a0    = static_cast<u32>(block & 0xff);
+    const u32 a1    = static_cast<u32>((block >> 8) & 0xff);
+    const u32 index = static_cast<u32>(block >> (16 + i * 3)) & 7;
+
+    if (index == 0) {
+        return static_cast<u8>(a0);
+    }
+    if (index == 1) {
+        return static_cast<u8>(a1);
+    }
+    if (a0 > a1) {
+        return static_cast<u8>(((8 - index) * a0 + (index - 1) * a1) / 7);
+    }
+    if (index >= 6) {
+        return index == 6 ? 0 : 255;
+    }
+
+    return static_cast<u8>(((6 - index) * a0 + (index - 1) * a1) / 5);
+}
+
+static i32 color_distance(const color_rgba &color0, const color_rgba &color1) {
+    const i32 r = color0.r() - color1.r();
+    const i32 g = color0.g() - color1.g();
+    const i32 b = color0.b() - color1.b();
+
+    return r * r + g * g + b * b;
+}
+
+// Encode the colors of 16 texels in four color mode, with endpoints on the principal axis of the colors.
+static u64 encode_color_block(const std::array<color_rgba, 16> &texels) {
+    vec3f mean{0.0f, 0.0f, 0.0f};
+
+    for (const color_rgba &texel : texels) {
+        mean = mean + vec3f{texel.r(), texel.g(), texel.b()};
+    }
+    mean = mean / 16.0f;
+
+    std::array<f32, 6> covariance{};  // xx, xy, xz, yy, yz, zz.
+
+    for (const color_rgba &texel : texels) {
+        const vec3f d = vec3f{texel.r(), texel.g(), texel.b()} - mean;
+
+        covariance[0] += d.x() * d.x();
+        covariance[1] += d.x() * d.y();
+        covariance[2] += d.x() * d.z();
+        covariance[3] += d.y() * d.y();
+        covariance[4] += d.y() * d.z();
+        covariance[5] += d.z() * d.z();
+    }
+
+    // A few rounds of power iteration are enough to find the axis.
+    vec3f axis{1.0f, 1.0f, 1.0f};
+
+    for (i32 i = 0; i < 4; ++i) {
+        axis = vec3f{covariance[0] * axis.x() + covariance[1] * axis.y() + covariance[2] * axis.z(),
+                     covariance[1] * axis.x() + covariance[3] * axis.y() + covariance[4] * axis.z(),
+                     covariance[2] * axis.x() + covariance[4] * axis.y() + covariance[5] * axis.z()};
+
+        const f32 length = std::max({std::abs(axis.x()), std::abs(axis.y()), std::abs(axis.z())});
+
+        if (length == 0.0f) {
+            axis = vec3f{0.0f, 0.0f, 0.0f};
+            break;
+        }
+        axis = axis / length;
+    }
+
+    f32 min_t = 0.0f;
+    f32 max_t = 0.0f;
+    const f32 length_sq = axis.x() * axis.x() + axis.y() * axis.y() + axis.z() * axis.z();
+
+    if (length_sq > 0.0f) {
+        for (const color_rgba &texel : texels) {
+            const vec3f d = vec3f{texel.r(), texel.g(), texel.b()} - mean;
+            const f32 t   = (d.x() * axis.x() + d.y() * axis.y() + d.z() * axis.z()) / length_sq;
+
+            min_t = std::min(min_t, t);
+            max_t = std::max(max_t, t);
+        }
+    }
+
+    u16 c0 = to_rgb565(mean + axis * max_t);
+    u16 c1 = to_rgb565(mean + axis * min_t);
+
+    if (c0 == c1) {
+        return c0 | static_cast<u64>(c1) << 16;
+    }
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+
+    const u64 endpoints = c0 | static_cast<u64>(c1) << 16;
+
+    std::array<color_rgba, 4> palette;
+
+    for (i32 i = 0; i < 4; ++i) {
+        palette[i] = decode_color(endpoints | static_cast<u64>(i) << 32, 0, true);
+    }
+
+    u64 indices = 0;
+
+    for (i32 i = 0; i < 16; ++i) {
+        u64 best = 0;
+
+        for (u64 j = 1; j < 4; ++j) {
+            if (color_distance(texels[i], palette[j]) < color_distance(texels[i], palette[best])) {
+                best = j;
+            }
+        }
+
+        indices |= best << (i * 2);
+    }
+
+    return endpoints | indices << 32;
+}
+
+// Encode the alpha of 16 texels with the lowest and highest alpha as endpoints.
+static u64 encode_alpha_block(const std::array<color_rgba, 16> &texels) {
+    u32 a0 = 0;
+    u32 a1 = 255;
+
+    for (const color_rgba &texel : texels) {
+        a0 = std::max<u32>(a0, texel.a());
+        a1 = std::min<u32>(a1, texel.a());
+    }
+
+    const u64 endpoints = a0 | a1 << 8;
+
+    if (a0 == a1) {
+        return endpoints;
+    }
+
+    std::array<u8, 8> palette;
+
+    for (i32 i = 0; i < 8; ++i) {
+        palette[i] = decode_alpha(endpoints | static_cast<u64>(i) << 16, 0);
+    }
+
+    u64 indices = 0;
+
+    for (i32 i = 0; i < 16; ++i) {
+        u64 best = 0;
+
+        for (u64 j = 1; j < 8; ++j) {
+            if (std::abs(texels[i].a() - palette[j]) < std::abs(texels[i].a() - palette[best])) {
+                best = j;
+            }
+        }
+
+        indices |= best << (i * 3);
+    }
+
+    return endpoints | indices << 16;
+}
+
+texture::texture(const image &image, texture_format format, bool premultiply_alpha)
+    : m_format{format}, m_is_premultiplied{premultiply_alpha} {
+    VLK_ASSERT(image.channels() == 3 || image.channels() == 4, "Image must be RGB or RGBA.");
+
+    level first{static_cast<i32>(image.width()), static_cast<i32>(image.height()), false, {}, {}};
+    first.texels.resize(image.width() * image.height());
+
+    const std::span<u8> texels{reinterpret_cast<u8 *>(first.texels.data()), first.texels.size() * 4};
+
+    if (image.channels() == 4) {
+        std::ranges::copy(image.data(), texels.begin());
+    } else {
+        convert_rgb_to_rgba(texels, image.data());
+    }
+
+    if (premultiply_alpha) {
+        vlk::premultiply_alpha(texels, texels);
+    }
+
+    m_levels.push_back(std::move(first));
+
+    while (m_levels.back().width > 1 || m_levels.back().height > 1) {
+        const level &prev = m_levels.back();
+
+        level next{std::max(prev.width / 2, 1), std::max(prev.height / 2, 1), false, {}, {}};
+        next.texels.resize(static_cast<size_t>(next.width) * static_cast<size_t>(next.height));
+
+        // Box filter. The last row or column of odd sized levels is dropped.
+        for (i32 y = 0; y < next.height; ++y) {
+            const i32 y0 = std::min(y * 2, prev.height - 1);
+            const i32 y1 = std::min(y * 2 + 1, prev.height - 1);
+
+            for (i32 x = 0; x < next.width; ++x) {
+                const i32 x0 = std::min(x * 2, prev.width - 1);
+                const i32 x1 = std::min(x * 2 + 1, prev.width - 1);
+
+                const color_rgba &t00 = prev.texels[y0 * prev.width + x0];
+                const color_rgba &t10 = prev.texels[y0 * prev.width + x1];
+                const color_rgba &t01 = prev.texels[y1 * prev.width + x0];
+                const color_rgba &t11 = prev.texels[y1 * prev.width + x1];
+
+                color_rgba &texel = next.texels[y * next.width + x];
+
+                for (i32 i = 0; i < 4; ++i) {
+                    texel[i] = static_cast<u8>((t00[i] + t10[i] + t01[i] + t11[i] + 2) / 4);
+                }
+            }
+        }
+
+        m_levels.push_back(std::move(next));
+    }
+
+    for (level &level : m_levels) {
+        level.is_power_of_two = std::has_single_bit(static_cast<u32>(level.width)) &&
+                                std::has_single_bit(static_cast<u32>(level.height));
+    }
+
+    m_log2_size = 0.5f * std::log2(static_cast<f32>(image.width()) * static_cast<f32>(image.height()));
+
+    if (format == texture_format::rgba8) {
+        return;
+    }
+
+    for (level &level : m_levels) {
+        const i32 blocks_x = (level.width + 3) / 4;
+        const i32 blocks_y = (level.height + 3) / 4;
+
+        const size_t block_size = format == texture_format::bc3 ? 2 : 1;
+        level.blocks.reserve(static_cast<size_t>(blocks_x * blocks_y) * block_size);
+
+        for (i32 block_y = 0; block_y < blocks_y; ++block_y) {
+            for (i32 block_x = 0; block_x < blocks_x; ++block_x) {
+                // Blocks that stick out of small levels repeat the last row and column.
+                std::array<color_rgba, 16> texels;
+
+                for (i32 i = 0; i < 16; ++i) {
+                    const i32 x = std::min(block_x * 4 + i % 4, level.width - 1);
+                    const i32 y = std::min(block_y * 4 + i / 4, level.height - 1);
+
+                    texels[i] = level.texels[y * level.width + x];
+                }
+
+                if (format == texture_format::bc3) {
+                    level.blocks.push_back(encode_alpha_block(texels));
+                }
+                level.blocks.push_back(encode_color_block(texels));
+            }
+        }
+
+        level.texels = {};
+    }
+}
+
+texture::texture(std::vector<level> levels, texture_format format, bool is_premultiplied)
+    : m_levels{std::move(levels)}, m_format{format}, m_is_premultiplied{is_premultiplied} {
+    VLK_ASSERT(!m_levels.empty(), "Texture must have a level.");
+
+    for (level &level : m_levels) {
+        level.is_power_of_two = std::has_single_bit(static_cast<u32>(level.width)) &&
+                                std::has_single_bit(static_cast<u32>(level.height));
+    }
+
+    const level &first = m_levels[0];
+    m_log2_size        = 0.5f * std::log2(static_cast<f32>(first.width) * static_cast<f32>(first.height));
+}
+
+color_rgba texture::texel(const level &level, i32 x, i32 y) const {
+    if (m_format == texture_format::rgba8) {
+        return level.texels[y * level.width + x];
+    }
+
+    const size_t block = static_cast<size_t>((y / 4) * ((level.width + 3) / 4) + x / 4);
+    const i32 i        = (y % 4) * 4 + x % 4;
+
+    if (m_format == texture_format::bc1) {
+        return decode_color(level.blocks[block], i, false);
+    }
+
+    color_rgba color = decode_color(level.blocks[block * 2 + 1], i, true);
+    color.a()        = decode_alpha(level.blocks[block * 2], i);
+
+    return color;
+}
+
+size_t texture::data_size() const {
+    size_t size = 0;
+
+    for (const level &level : m_levels) {
+        size += level.texels.size() * sizeof(color_rgba) + level.blocks.size() * sizeof(u64);
+    }
+
+    return size;
+}
+
+// Texel coordinate wrapped into [0, size). Coordinates are at most one texel outside of that.
+static i32 wrap_texel(i32 x, i32 size, bool is_power_of_two, texture_wrap wrap) {
+    if (wrap == texture_wrap::clamp) {
+        return std::clamp(x, 0, size - 1);
+    }
+    if (is_power_of_two) {
+        return x & (size - 1);
+    }
+
+    return x < 0 ? x + size : (x >= size ? x - size : x);
+}
+
+// Texture coordinate brought into [0, 1], so it can be turned into a texel coordinate without overflowing.
+static f32 wrap_tex_coord(f32 x, texture_wrap wrap) {
+    return wrap == texture_wrap::repeat ? x - std::floor(x) : std::clamp(x, 0.0f, 1.0f);
+}
+
+color_rgba texture::sample_nearest(const level &level, vec2f tex_coord) const {
+    const f32 u = wrap_tex_coord(tex_coord.x(), wrap) * static_cast<f32>(level.width);
+    const f32 v = wrap_tex_coord(tex_coord.y(), wrap) * static_cast<f32>(level.height);
+
+    const i32 x = wrap_texel(static_cast<i32>(u), level.width, level.is_power_of_two, wrap);
+    const i32 y = wrap_texel(static_cast<i32>(v), level.height, level.is_power_of_two, wrap);
+
+    return texel(level, x, y);
+}
+
+color_rgba texture::sample_bilinear(const level &level, vec2f tex_coord) const {
+    // Texel coordinates in 1/256ths of a texel, texel centers are at + 0.5.
+    const f32 scale_x = static_cast<f32>(level.width * 256);
+    const f32 scale_y = static_cast<f32>(level.height * 256);
+    const i32 u       = static_cast<i32>(wrap_tex_coord(tex_coord.x(), wrap) * scale_x) - 128;
+    const i32 v       = static_cast<i32>(wrap_tex_coord(tex_coord.y(), wrap) * scale_y) - 128;
+
+    const i32 x0 = wrap_texel(u >> 8, level.width, level.is_power_of_two, wrap);
+    const i32 x1 = wrap_texel((u >> 8) + 1, level.width, level.is_power_of_two, wrap);
+    const i32 y0 = wrap_texel(v >> 8, level.height, level.is_power_of_two, wrap);
+    const i32 y1 = wrap_texel((v >> 8) + 1, level.height, level.is_power_of_two, wrap);
+
+    // Weights of the second texel in each direction.
+    const i32 weight_x = u & 255;
+    const i32 weight_y = v & 255;
+
+#if defined(VLK_SSE2)
+    // The four texels as [top left, top right, bottom left, bottom right].
+    __m128i texels;
+
+    if (m_format == texture_format::rgba8) {
+        const i32 *data = reinterpret_cast<const i32 *>(level.texels.data());
+        const i32 row0  = y0 * level.width;
+        const i32 row1  = y1 * level.width;
+
+#if defined(VLK_AVX2)
+        texels = _mm_i32gather_epi32(data, _mm_setr_epi32(row0 + x0, row0 + x1, row1 + x0, row1 + x1), 4);
+#else
+        texels = _mm_setr_epi32(data[row0 + x0], data[row0 + x1], data[row1 + x0], data[row1 + x1]);
+#endif
+    } else {
+        auto bits = [](const color_rgba &color) { return std::bit_cast<i32>(color); };
+
+        texels = _mm_setr_epi32(bits(texel(level, x0, y0)), bits(texel(level, x1, y0)),
+                                bits(texel(level, x0, y1)), bits(texel(level, x1, y1)));
+    }
+
+    const __m128i zero     = _mm_setzero_si128();
+    const __m128i half     = _mm_set1_epi16(128);
+    const __m128i weight_h = _mm_unpacklo_epi64(_mm_set1_epi16(static_cast<i16>(256 - weight_x)),
+                                                _mm_set1_epi16(static_cast<i16>(weight_x)));
+    const __m128i weight_v = _mm_unpacklo_epi64(_mm_set1_epi16(static_cast<i16>(256 - weight_y)),
+                                                _mm_set1_epi16(static_cast<i16>(weight_y)));
+
+    // Blend the two texels of a row, which are in the low and high half of a register.
+    auto lerp_halves = [&](__m128i pair, __m128i weight) {
+        const __m128i weighted = _mm_mullo_epi16(pair, weight);
+        return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(weighted, _mm_srli_si128(weighted, 8)), half), 8);
+    };
+
+    const __m128i top    = lerp_halves(_mm_unpacklo_epi8(texels, zero), weight_h);
+    const __m128i bottom = lerp_halves(_mm_unpackhi_epi8(texels, zero), weight_h);
+    const __m128i result = lerp_halves(_mm_unpacklo_epi64(top, bottom), weight_v);
+
+    return std::bit_cast<color_rgba>(_mm_cvtsi128_si32(_mm_packus_epi16(result, zero)));
+#else
+    const color_rgba t00 = texel(level, x0, y0);
+    const color_rgba t10 = texel(level, x1, y0);
+    const color_rgba t01 = texel(level, x0, y1);
+    const color_rgba t11 = texel(level, x1, y1);
+
+    color_rgba color;
+
+    for (i32 i = 0; i < 4; ++i) {
+        const i32 top    = (t00[i] * (256 - weight_x) + t10[i] * weight_x + 128) >> 8;
+        const i32 bottom = (t01[i] * (256 - weight_x) + t11[i] * weight_x + 128) >> 8;
+
+        color[i] = static_cast<u8>((top * (256 - weight_y) + bottom * weight_y + 128) >> 8);
+    }
+
+    return color;
+#endif
+}
+
+color_rgba texture::sample(vec2f tex_coord, f32 level_of_detail) const {
+    VLK_ASSERT_FAST(!m_levels.empty(), "Texture is empty.");
+
+    const f32 last_level = static_cast<f32>(m_levels.size() - 1);
+    const f32 lod        = std::clamp(level_of_detail, 0.0f, last_level);
+
+    switch (filter) {
+        case texture_filter::nearest:
+            return sample_nearest(m_levels[static_cast<size_t>(lod + 0.5f)], tex_coord);
+        case texture_filter::bilinear:
+            return sample_bilinear(m_levels[static_cast<size_t>(lod + 0.5f)], tex_coord);
+        case texture_filter::trilinear:
+            break;
+    }
+
+    const size_t level  = static_cast<size_t>(lod);
+    const i32 weight    = static_cast<i32>((lod - static_cast<f32>(level)) * 256.0f);
+    const color_rgba c0 = sample_bilinear(m_levels[level], tex_coord);
+
+    if (weight == 0) {
+        return c0;
+    }
+
+    const color_rgba c1 = sample_bilinear(m_levels[level + 1], tex_coord);
+
+    color_rgba color;
+
+    for (i32 i = 0; i < 4; ++i) {
+        color[i] = static_cast<u8>((c0[i] * (256 - weight) + c1[i] * weight + 128) >> 8);
+    }
+
+    return color;
+}
+
 color_rgba vlk::default_model_pixel_shader(const vertex &vertex, const model &model, size_t material_index) {
     const vec2f tex_coord = vertex[0].data.xy();
     const vec3f normal    = vertex[1].data.xyz();
@@ -454,6 +1326,12 @@ color_rgba vlk::default_model_pixel_shader(const vertex &vertex, const model &mo
 
     const model::material &material = model.materials[material_index];
 
+    if (material.albedo != model::null_index && material.albedo < model.textures.size()) {
+        // render_model() passes the texture coordinate scale as the last attribute.
+        const texture &texture = model.textures[material.albedo];
+        return texture.sample(tex_coord, texture.level_of_detail(vertex[vertex.count - 1][0]));
+    }
+
     if (material.albedo != model::null_index) {
         auto pixel = model.images[material.albedo].sample(tex_coord.x(), tex_coord.y());
         result.r() = *pixel;
@@ -465,45 +1343,153 @@ color_rgba vlk::default_model_pixel_shader(const vertex &vertex, const model &mo
     return result;
 }
 
-void vlk::render_model(const render_model_params &params) {
-    for (auto &mesh : params.model.meshes) {
-        for (auto &face : mesh.faces) {
-            std::array<vertex, 3> vertices{vertex{{params.model.positions[face.positions[0]], 1.0f}},
-                                           vertex{{params.model.positions[face.positions[1]], 1.0f}},
-                                           vertex{{params.model.positions[face.positions[2]], 1.0f}}};
-
-            for (auto &vertex : vertices) {
-                vertex.pos *= params.mvp_matrix;
-            }
+model::model(const model &other)
+    : positions{other.positions},
+      tex_coords{other.tex_coords},
+      normals{other.normals},
+      meshes{other.meshes},
+      materials{other.materials},
+      images{other.images},
+      textures{other.textures} {
+    copied_bytes += other.data_size();
+}
 
-            if (mesh.has_tex_coords) {
-                for (u8 i = 0; i < 3; ++i) {
-                    attrib &attrib         = vertices[i][vertices[i].count++];
-                    const vec2f &tex_coord = params.model.tex_coords[face.tex_coords[i]];
+model &model::operator=(const model &other) {
+    return *this = model{other};
+}
 
-                    attrib.data.x() = tex_coord.x();
-                    attrib.data.y() = tex_coord.y();
-                    attrib.size     = 2;
-                }
-            }
-            if (mesh.has_normals) {
-                for (u8 i = 0; i < 3; ++i) {
-                    attrib &attrib      = vertices[i][vertices[i].count++];
-                    const vec3f &normal = params.model.normals[face.normals[i]] * params.normal_matrix;
-
-                    attrib.data.x() = normal.x();
-                    attrib.data.y() = normal.y();
-                    attrib.data.z() = normal.z();
-                    attrib.size     = 3;
-                }
+size_t model::data_size() const {
+    size_t size = positions.size() * sizeof(vec3f) + tex_coords.size() * sizeof(vec2f) +
+                  normals.size() * sizeof(vec3f);
+
+    for (const auto &mesh : meshes) {
+        size += sizeof(mesh) + mesh.faces.size() * sizeof(model::mesh::face);
+    }
+    for (const auto &material : materials) {
+        size += sizeof(material) + material.name.size();
+    }
+    for (const auto &image : images) {
+        size += image.width() * image.height() * image.channels();
+    }
+    for (const auto &texture : textures) {
+        size += texture.data_size();
+    }
+
+    return size;
+}
+
+static bool is_opaque(const image &image) {
+    if (image.channels() != 4) {
+        return true;
+    }
+
+    for (size_t y = 0; y < image.height(); ++y) {
+        for (size_t x = 0; x < image.width(); ++x) {
+            if (*(image.at(x, y) + 3) != 255) {
+                return false;
             }
+        }
+    }
+
+    return true;
+}
+
+void model::build_textures(bool compress, bool premultiply_alpha) {
+    textures.clear();
+
+    for (const auto &image : images) {
+        if (compress) {
+            textures.emplace_back(image, is_opaque(image) ? texture_format::bc1 : texture_format::bc3,
+                                  premultiply_alpha);
+        } else {
+            textures.emplace_back(image, texture_format::rgba8, premultiply_alpha);
+        }
+    }
+
+    if (compress) {
+        images.clear();
+    }
+}
+
+void raster::transformed_model::transform(const model &model, const mat4 &mvp_matrix,
+                                          const mat3 &normal_matrix, vec2i framebuffer_size) {
+    clip_positions.resize(model.positions.size());
+    screen_positions.resize(model.positions.size());
+    outcodes.resize(model.positions.size());
+    normals.resize(model.normals.size());
+
+    const vec2f guard = guard_band(framebuffer_size);
+
+    for (size_t i = 0; i < model.positions.size(); ++i) {
+        clip_positions[i] = vec4f{model.positions[i], 1.0f} * mvp_matrix;
+        outcodes[i]       = outcode(clip_positions[i], guard);
+
+        if ((outcodes[i] & clip_planes) == 0) {
+            screen_positions[i] = setup_position(clip_positions[i], framebuffer_size);
+        }
+    }
+
+    for (size_t i = 0; i < model.normals.size(); ++i) {
+        normals[i] = model.normals[i] * normal_matrix;
+    }
+}
+
+raster::transformed_model &raster::transformed_model::scratch() {
+    thread_local transformed_model transformed;
+    return transformed;
+}
 
-            render_triangle({.vertices     = vertices,
-                             .color_buf    = params.color_buf,
-                             .depth_buf    = params.depth_buf,
-                             .pixel_shader = [&](const vertex &vertex) {
-                                 return params.pixel_shader(vertex, params.model, mesh.material_index);
-                             }});
+std::array<vertex, 3> raster::model_face_vertices(const model &model, const model::mesh &mesh,
+                                                  const model::mesh::face &face,
+                                                  std::span<const vec4f> positions,
+                                                  std::span<const vec3f> normals) {
+    std::array<vertex, 3> vertices{vertex{positions[face.positions[0]]}, vertex{positions[face.positions[1]]},
+                                   vertex{positions[face.positions[2]]}};
+
+    if (mesh.has_tex_coords) {
+        for (u8 i = 0; i < 3; ++i) {
+            attrib &attrib         = vertices[i][vertices[i].count++];
+            const vec2f &tex_coord = model.tex_coords[face.tex_coords[i]];
+
+            attrib.data.x() = tex_coord.x();
+            attrib.data.y() = tex_coord.y();
+            attrib.size     = 2;
+        }
+    }
+    if (mesh.has_normals) {
+        for (u8 i = 0; i < 3; ++i) {
+            attrib &attrib      = vertices[i][vertices[i].count++];
+            const vec3f &normal = normals[face.normals[i]];
+
+            attrib.data.x() = normal.x();
+            attrib.data.y() = normal.y();
+            attrib.data.z() = normal.z();
+            attrib.size     = 3;
         }
     }
+
+    return vertices;
+}
+
+void raster::add_tex_coord_scale(std::array<vertex, 3> &vertices) {
+    auto area = [](vec2f a, vec2f b, vec2f c) {
+        return std::abs((b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x()));
+    };
+
+    const f32 screen_area = area(vertices[0].pos.xy(), vertices[1].pos.xy(), vertices[2].pos.xy());
+    const f32 tex_coord_area =
+        area(vertices[0][0].data.xy(), vertices[1][0].data.xy(), vertices[2][0].data.xy());
+
+    // Areas scale with the square of the lengths. Triangles without a texture coordinate area sample the
+    // first mip level.
+    const f32 scale =
+        screen_area > 0.0f && tex_coord_area > 0.0f ? 0.5f * std::log2(tex_coord_area / screen_area) : -64.0f;
+
+    for (vertex &vertex : vertices) {
+        vertex[vertex.count++] = attrib{scale};
+    }
+}
+
+void vlk::render_model(const render_model_params &params) {
+    render_model<model_pixel_shader_func, color_blend_func>(params);
 }
\ No newline at end of file
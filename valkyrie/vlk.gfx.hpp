@@ -1,60 +1,298 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <array>
 #include <string>
 #include <functional>
+#include <span>
+#include <atomic>
+#include <cstring>
 
 #include "vlk.types.hpp"
 #include "vlk.math.hpp"
+#include "vlk.pixels.hpp"
 
 #ifndef VLK_MAX_ATTRIBUTES
 #define VLK_MAX_ATTRIBUTES 4
 #endif
 
+// Width and height in pixels of the screen tiles used by the multithreaded rasterizer.
+#ifndef VLK_TILE_SIZE
+#define VLK_TILE_SIZE 64
+#endif
+
 namespace vlk {
     using color_rgb  = vec3<u8>;
     using color_rgba = vec4<u8>;
 
     static_assert(sizeof(color_rgb) == 3 && sizeof(color_rgba) == 4);
 
+    /*
+     * Order of a buffer's pixels in memory. Linear buffers are stored row by row. Tiled buffers are stored in
+     * 8x8 tiles, row by row within a tile, so a block of pixels drawn by the rasterizer shares a few cache
+     * lines instead of touching a new one on every row.
+     *
+     * NOTE: Pixels are addressed by x and y either way, only the indices taken by operator[] follow the
+     *       layout. Use for_each_run() to copy a buffer to row by row memory.
+     */
+    enum class buffer_layout {
+        linear,
+        tiled,
+    };
+
+    /*
+     * 2D buffer of pixels.
+     *
+     * Clearing is lazy: clear() only stores the value and marks every 8x8 tile as cleared, and a tile is
+     * filled with the value the first time one of its pixels is accessed for writing. Reading a cleared
+     * tile returns the value without filling it.
+     */
     template <typename T>
     class buffer {
     public:
-        buffer(size_t width, size_t height) : m_width{width}, m_height{height} {
-            m_data.resize(width * height);
+        static constexpr size_t tile_size = 8;
+
+        buffer(size_t width, size_t height, buffer_layout layout = buffer_layout::linear)
+            : m_width{width},
+              m_height{height},
+              m_layout{layout},
+              m_tiles_x{(width + tile_size - 1) / tile_size},
+              m_tile_cleared(m_tiles_x * ((height + tile_size - 1) / tile_size), false),
+              m_clear_value{},
+              m_clear_run(width) {
+            if (layout == buffer_layout::linear) {
+                m_data.resize(width * height);
+            } else {
+                m_data.resize(m_tile_cleared.size() * tile_size * tile_size);
+            }
         }
 
-        void clear(T value) { std::fill(m_data.begin(), m_data.end(), value); }
+        void clear(T value) {
+            m_clear_value = value;
+            std::fill(m_clear_run.begin(), m_clear_run.end(), value);
+            std::fill(m_tile_cleared.begin(), m_tile_cleared.end(), true);
+            m_cleared_tile_count = m_tile_cleared.size();
+        }
 
         size_t width() const { return m_width; }
         size_t height() const { return m_height; }
+        buffer_layout layout() const { return m_layout; }
 
         T &operator[](size_t i) {
             VLK_ASSERT_FAST(i >= 0 && i < m_data.size(), "Out of bounds.");
+
+            if (has_cleared_tiles()) {
+                resolve_tile(tile_of_index(i));
+            }
+
             return m_data[i];
         }
         const T &operator[](size_t i) const {
             VLK_ASSERT_FAST(i >= 0 && i < m_data.size(), "Out of bounds.");
-            return m_data[i];
+            return has_cleared_tiles() && m_tile_cleared[tile_of_index(i)] ? m_clear_value : m_data[i];
         }
 
-        T &at(size_t x, size_t y) { return (*this)[y * width() + x]; }
-        const T &at(size_t x, size_t y) const { return (*this)[y * width() + x]; }
+        size_t index(size_t x, size_t y) const {
+            if (m_layout == buffer_layout::linear) {
+                return y * m_width + x;
+            }
+
+            return tile_of(x, y) * tile_size * tile_size + (y % tile_size) * tile_size + x % tile_size;
+        }
+
+        T &at(size_t x, size_t y) {
+            VLK_ASSERT_FAST(x < m_width && y < m_height, "Out of bounds.");
+
+            if (has_cleared_tiles()) {
+                resolve_tile(tile_of(x, y));
+            }
+
+            return m_data[index(x, y)];
+        }
+        const T &at(size_t x, size_t y) const {
+            VLK_ASSERT_FAST(x < m_width && y < m_height, "Out of bounds.");
+            return has_cleared_tiles() && m_tile_cleared[tile_of(x, y)] ? m_clear_value : m_data[index(x, y)];
+        }
 
         T sample(f32 x, f32 y) const {
             return at(static_cast<size_t>(std::round(x * static_cast<f32>(width() - 1))),
                       static_cast<size_t>(std::round(y * static_cast<f32>(height() - 1))));
         }
 
+        // Calls func(x, y, pixels) for each run of pixels of a row that's contiguous in memory, row by row
+        // and left to right. Runs of cleared tiles are read from the clear value without filling them.
+        template <typename F>
+        void for_each_run(F &&func) const {
+            for (size_t y = 0; y < m_height; ++y) {
+                const size_t row_tile = (y / tile_size) * m_tiles_x;
+
+                for (size_t x = 0; x < m_width;) {
+                    const bool is_cleared = m_tile_cleared[row_tile + x / tile_size];
+                    size_t end            = std::min((x / tile_size + 1) * tile_size, m_width);
+
+                    // Neighbouring tiles in a row are only contiguous in memory in a linear buffer.
+                    if (is_cleared || m_layout == buffer_layout::linear) {
+                        while (end < m_width && m_tile_cleared[row_tile + end / tile_size] == is_cleared) {
+                            end = std::min(end + tile_size, m_width);
+                        }
+                    }
+
+                    const T *run = is_cleared ? m_clear_run.data() : &m_data[index(x, y)];
+                    func(x, y, std::span<const T>{run, end - x});
+
+                    x = end;
+                }
+            }
+        }
+
+        // Calls func(x, pixels) for each run of the pixels of row y from start_x up to end_x that's
+        // contiguous in memory, left to right.
+        template <typename F>
+        void for_each_run(size_t y, size_t start_x, size_t end_x, F &&func) {
+            VLK_ASSERT_FAST(y < m_height && start_x <= end_x && end_x <= m_width, "Out of bounds.");
+
+            const size_t row_tile = (y / tile_size) * m_tiles_x;
+
+            for (size_t x = start_x; x < end_x;) {
+                const size_t tile_end = (x / tile_size + 1) * tile_size;
+                const size_t end      = m_layout == buffer_layout::linear ? end_x : std::min(tile_end, end_x);
+
+                for (size_t tile_x = x / tile_size; tile_x * tile_size < end; ++tile_x) {
+                    resolve_tile(row_tile + tile_x);
+                }
+
+                func(x, std::span<T>{&m_data[index(x, y)], end - x});
+
+                x = end;
+            }
+        }
+
+        // Same as above, runs of cleared tiles are read from the clear value without filling them.
+        template <typename F>
+        void for_each_run(size_t y, size_t start_x, size_t end_x, F &&func) const {
+            VLK_ASSERT_FAST(y < m_height && start_x <= end_x && end_x <= m_width, "Out of bounds.");
+
+            const size_t row_tile = (y / tile_size) * m_tiles_x;
+
+            for (size_t x = start_x; x < end_x;) {
+                const bool is_cleared = m_tile_cleared[row_tile + x / tile_size];
+                size_t end            = std::min((x / tile_size + 1) * tile_size, end_x);
+
+                if (is_cleared || m_layout == buffer_layout::linear) {
+                    while (end < end_x && m_tile_cleared[row_tile + end / tile_size] == is_cleared) {
+                        end = std::min(end + tile_size, end_x);
+                    }
+                }
+
+                const T *run = is_cleared ? m_clear_run.data() : &m_data[index(x, y)];
+                func(x, std::span<const T>{run, end - x});
+
+                x = end;
+            }
+        }
+
     protected:
         size_t m_width;
         size_t m_height;
+        buffer_layout m_layout;
+        size_t m_tiles_x;
         std::vector<T> m_data;
+        std::vector<u8> m_tile_cleared;
+        T m_clear_value;
+        std::vector<T> m_clear_run;
+
+        // Tiles that are still cleared. Threads resolve the tiles they draw to at the same time, so it's
+        // only accessed through atomic_ref while drawing.
+        mutable size_t m_cleared_tile_count = 0;
+
+        // Once every tile has been resolved, pixel accesses skip finding their tile.
+        bool has_cleared_tiles() const {
+            return std::atomic_ref{m_cleared_tile_count}.load(std::memory_order_relaxed) != 0;
+        }
+
+        size_t tile_of(size_t x, size_t y) const { return (y / tile_size) * m_tiles_x + x / tile_size; }
+
+        size_t tile_of_index(size_t i) const {
+            if (m_layout == buffer_layout::linear) {
+                return tile_of(i % m_width, i / m_width);
+            }
+
+            return i / (tile_size * tile_size);
+        }
+
+        // Fill a cleared tile with the clear value.
+        void resolve_tile(size_t tile) {
+            if (!m_tile_cleared[tile]) {
+                return;
+            }
+
+            m_tile_cleared[tile] = false;
+            std::atomic_ref{m_cleared_tile_count}.fetch_sub(1, std::memory_order_relaxed);
+
+            if (m_layout == buffer_layout::tiled) {
+                const size_t pixel_count = tile_size * tile_size;
+                std::fill_n(m_data.begin() + tile * pixel_count, pixel_count, m_clear_value);
+                return;
+            }
+
+            const size_t start_x = (tile % m_tiles_x) * tile_size;
+            const size_t start_y = (tile / m_tiles_x) * tile_size;
+            const size_t count   = std::min(tile_size, m_width - start_x);
+
+            for (size_t y = start_y; y < std::min(start_y + tile_size, m_height); ++y) {
+                std::fill_n(m_data.begin() + y * m_width + start_x, count, m_clear_value);
+            }
+        }
     };
 
     using color_buffer = buffer<color_rgba>;
-    using depth_buffer = buffer<f32>;
+
+    /*
+     * Depth buffer that also keeps a conservative min/max depth per block of pixels. The rasterizer uses
+     * these to skip the parts of a triangle that are hidden behind what's already been drawn and to skip the
+     * depth test where a triangle is in front of everything, and keeps them up to date as it writes depth.
+     *
+     * NOTE: The bounds only stay valid while depth values are lowered. Call update_bounds() after writing to
+     *       the buffer other than through the draw functions.
+     */
+    class depth_buffer : public buffer<f32> {
+    public:
+        static constexpr size_t block_size = 8;
+
+        static_assert(block_size == tile_size, "Blocks are expected to be tiles.");
+        static_assert(VLK_TILE_SIZE % block_size == 0,
+                      "Each block has to be in a single rasterizer tile, so no two threads write to it.");
+
+        struct bounds {
+            f32 min;
+            f32 max;
+        };
+
+        depth_buffer(size_t width, size_t height, buffer_layout layout = buffer_layout::linear)
+            : buffer{width, height, layout},
+              m_blocks_x{(width + block_size - 1) / block_size},
+              m_bounds(m_blocks_x * ((height + block_size - 1) / block_size), {0.0f, 0.0f}) {}
+
+        void clear(f32 value) {
+            buffer::clear(value);
+            std::fill(m_bounds.begin(), m_bounds.end(), bounds{value, value});
+        }
+
+        // Recompute the bounds of every block from the depth values.
+        void update_bounds();
+
+        bounds &block_bounds(size_t block_x, size_t block_y) {
+            return m_bounds[block_y * m_blocks_x + block_x];
+        }
+        const bounds &block_bounds(size_t block_x, size_t block_y) const {
+            return m_bounds[block_y * m_blocks_x + block_x];
+        }
+
+    private:
+        size_t m_blocks_x;
+        std::vector<bounds> m_bounds;
+    };
 
     class attrib {
     public:
@@ -103,54 +341,212 @@ namespace vlk {
         std::array<attrib, VLK_MAX_ATTRIBUTES> m_attribs;
     };
 
-    struct line {
-        vertex start;
-        vertex end;
+    using pixel_shader_func = std::function<color_rgba(const vertex &)>;
+
+    using color_blend_func =
+        std::function<color_rgba(const color_rgba &old_color, const color_rgba &new_color)>;
+
+    // How a color is combined with the color already in a buffer.
+    enum class blend_mode {
+        replace,   // The new color.
+        alpha,     // The new color over the old one, weighted by the new color's alpha.
+        add,       // Sum of both colors, saturated at 255.
+        multiply,  // Product of both colors, channel by channel.
+
+        // The new color over the old one, both with their colors premultiplied by their alpha. Cheaper
+        // than alpha since it needs no divide, and what transparent windows expect.
+        premultiplied,
     };
 
-    class line_stepper {
-    public:
-        enum class calc_steps_based_on {
-            largest_diff,
-            x_diff,
-            y_diff,
-        };
+    /*
+     * Blends a single color with integer math. Alpha blending follows the float formula this replaced:
+     *
+     *   a   = new.a + old.a * (1 - new.a)
+     *   rgb = new.rgb * new.a + old.rgb * old.a * (1 - new.a) / a
+     *
+     * rounded to the nearest integer where the float version truncated, so results can be 1 higher.
+     * Premultiplied alpha blending is a multiply-add per channel:
+     *
+     *   rgba = new.rgba + old.rgba * (1 - new.a)
+     */
+    inline color_rgba blend(blend_mode mode, const color_rgba &old_color, const color_rgba &new_color) {
+        switch (mode) {
+            case blend_mode::replace:
+                return new_color;
+            case blend_mode::alpha:
+                break;
+            case blend_mode::premultiplied: {
+                const u32 inv_a = 255 - new_color.a();
+                return {std::min(new_color.r() + div_255(old_color.r() * inv_a), 255u),
+                        std::min(new_color.g() + div_255(old_color.g() * inv_a), 255u),
+                        std::min(new_color.b() + div_255(old_color.b() * inv_a), 255u),
+                        std::min(new_color.a() + div_255(old_color.a() * inv_a), 255u)};
+            }
+            case blend_mode::add:
+                return {std::min(old_color.r() + new_color.r(), 255),
+                        std::min(old_color.g() + new_color.g(), 255),
+                        std::min(old_color.b() + new_color.b(), 255),
+                        std::min(old_color.a() + new_color.a(), 255)};
+            case blend_mode::multiply:
+                return {div_255(old_color.r() * new_color.r()), div_255(old_color.g() * new_color.g()),
+                        div_255(old_color.b() * new_color.b()), div_255(old_color.a() * new_color.a())};
+        }
 
-        line_stepper(line line, calc_steps_based_on line_type = calc_steps_based_on::largest_diff);
+        const u32 new_a = new_color.a();
+        const u32 old_a = old_color.a();
 
-        const vertex &vertex() const { return m_current; }
+        if (new_a == 255) {
+            return new_color;
+        }
+        if (new_a == 0) {
+            return old_color;
+        }
 
-        bool step();
+        if (old_a == 255) {
+            const u32 old_bits = std::bit_cast<u32>(old_color);
+            const u32 new_bits = std::bit_cast<u32>(new_color);
 
-    private:
-        vlk::vertex m_current;
-        vlk::vertex m_increment;
+            // Red and blue, then green, in two 16-bit halves of a u32 at a time.
+            u32 rb = (new_bits & 0xff00ff) * new_a + (old_bits & 0xff00ff) * (255 - new_a) + 0x800080;
+            u32 g  = ((new_bits >> 8) & 0xff) * new_a + ((old_bits >> 8) & 0xff) * (255 - new_a) + 0x80;
+            rb     = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+            g      = ((g + (g >> 8)) >> 8) & 0xff;
 
-        u32 m_steps;
-        u32 m_i;
-    };
+            return std::bit_cast<color_rgba>(rb | g << 8 | 0xff000000);
+        }
 
-    using pixel_shader_func = std::function<color_rgba(const vertex &)>;
+        // Both alphas and the alpha of the result are scaled by 255 * 255 here.
+        const u64 old_weight = old_a * (255 - new_a);
+        const u64 a          = new_a * 255 + old_weight;
 
-    using color_blend_func =
-        std::function<color_rgba(const color_rgba &old_color, const color_rgba &new_color)>;
+        color_rgba result;
+
+        for (i32 i = 0; i < 3; ++i) {
+            const u64 numerator   = new_color[i] * new_a * a + old_color[i] * old_weight * 255;
+            const u64 denominator = a * 255;
+            result[i] = static_cast<u8>(std::min<u64>((numerator + denominator / 2) / denominator, 255));
+        }
+        result.a() = static_cast<u8>(div_255(static_cast<u32>(a)));
+
+        return result;
+    }
+
+    // Blends the colors of a run of pixels into it, with SIMD where available.
+    void blend_span(blend_mode mode, std::span<color_rgba> pixels, std::span<const color_rgba> colors);
 
-    color_rgba default_color_blend(const color_rgba &old_color, const color_rgba &new_color);
+    // Blends a single color into every pixel of a run.
+    void blend_span(blend_mode mode, std::span<color_rgba> pixels, const color_rgba &color);
 
-    struct render_triangle_params {
+    inline color_rgba default_color_blend(const color_rgba &old_color, const color_rgba &new_color) {
+        return blend(blend_mode::alpha, old_color, new_color);
+    }
+
+    // Function object version of default_color_blend() that the templated draw functions can inline.
+    struct default_color_blend_op {
+        color_rgba operator()(const color_rgba &old_color, const color_rgba &new_color) const {
+            return default_color_blend(old_color, new_color);
+        }
+    };
+
+    // Color blend for buffers that hold premultiplied alpha, e.g. drawn with textures created with
+    // premultiply_alpha.
+    struct premultiplied_color_blend_op {
+        color_rgba operator()(const color_rgba &old_color, const color_rgba &new_color) const {
+            return blend(blend_mode::premultiplied, old_color, new_color);
+        }
+    };
+
+    // Which triangles to skip, by their winding in normalized device coordinates. Counter-clockwise
+    // triangles are front facing.
+    enum class cull_mode {
+        none,
+        back,
+        front
+    };
+
+    /*
+     * The draw functions come in two flavours. The basic_*_params templates take the pixel shader and color
+     * blend function as template parameters, which lets the compiler inline them into the pixel loop:
+     *
+     *   render_triangle(basic_render_triangle_params{.vertices = ..., .pixel_shader = [&](...) {...}});
+     *
+     * The non-template overloads take std::function's and are a thin wrapper around the templated ones.
+     */
+
+    template <typename PixelShader, typename ColorBlend = default_color_blend_op>
+    struct basic_render_triangle_params {
         std::array<vertex, 3> vertices;
         optional_ref<color_buffer> color_buf;
         optional_ref<depth_buffer> depth_buf;
-        pixel_shader_func pixel_shader;
-        color_blend_func color_blend = default_color_blend;
+        PixelShader pixel_shader;
+        ColorBlend color_blend = default_color_blend_op{};
+        cull_mode cull         = cull_mode::none;
     };
 
+    using render_triangle_params = basic_render_triangle_params<pixel_shader_func, color_blend_func>;
+
+    template <typename PixelShader, typename ColorBlend>
+    void render_triangle(const basic_render_triangle_params<PixelShader, ColorBlend> &params);
+
     void render_triangle(const render_triangle_params &params);
 
+    template <typename PixelShader, typename ColorBlend = default_color_blend_op>
+    struct basic_render_triangles_params {
+        std::span<const std::array<vertex, 3>> triangles;
+        optional_ref<color_buffer> color_buf;
+        optional_ref<depth_buffer> depth_buf;
+        PixelShader pixel_shader;
+        ColorBlend color_blend = default_color_blend_op{};
+        cull_mode cull         = cull_mode::none;
+
+        // Bin the triangles into screen tiles and rasterize the tiles in parallel.
+        // The pixel shader and color blend function must then be safe to call from multiple threads.
+        bool multithreaded = true;
+    };
+
+    using render_triangles_params = basic_render_triangles_params<pixel_shader_func, color_blend_func>;
+
+    // Same result as calling render_triangle() for each triangle in order.
+    template <typename PixelShader, typename ColorBlend>
+    void render_triangles(const basic_render_triangles_params<PixelShader, ColorBlend> &params);
+
+    void render_triangles(const render_triangles_params &params);
+
+    template <typename PixelShader, typename ColorBlend = default_color_blend_op>
+    struct basic_render_indexed_params {
+        std::span<const vec4f> positions;  // Clip space.
+
+        // Per-vertex attribute streams, indexed like positions. Attribute i of a vertex is read from
+        // attribs[i], the first empty stream ends the list.
+        std::array<std::span<const attrib>, VLK_MAX_ATTRIBUTES> attribs;
+
+        // Three per triangle.
+        std::span<const u32> indices;
+
+        optional_ref<color_buffer> color_buf;
+        optional_ref<depth_buffer> depth_buf;
+        PixelShader pixel_shader;
+        ColorBlend color_blend = default_color_blend_op{};
+        cull_mode cull         = cull_mode::none;
+
+        // See basic_render_triangles_params::multithreaded.
+        bool multithreaded = false;
+    };
+
+    using render_indexed_params = basic_render_indexed_params<pixel_shader_func, color_blend_func>;
+
+    // Draw indexed triangles. Each vertex is classified against the view volume and transformed to screen
+    // space once, however many triangles share it.
+    template <typename PixelShader, typename ColorBlend>
+    void render_indexed(const basic_render_indexed_params<PixelShader, ColorBlend> &params);
+
+    void render_indexed(const render_indexed_params &params);
+
     struct render_rect_color_params {
         rect<size_t> dst;
         color_rgba color;
         color_buffer &color_buf;
+        blend_mode blend = blend_mode::alpha;
     };
 
     void render_rect_color(const render_rect_color_params &params);
@@ -174,6 +570,10 @@ namespace vlk {
         size_t height() const { return m_height; }
         size_t channels() const { return m_channels; }
 
+        // The pixels row by row, with the channels of each pixel in order.
+        std::span<u8> data() { return m_data; }
+        std::span<const u8> data() const { return m_data; }
+
         std::vector<u8>::iterator at(size_t x, size_t y);
         std::vector<u8>::const_iterator at(size_t x, size_t y) const;
 
@@ -193,15 +593,115 @@ namespace vlk {
         std::vector<u8> m_data;
     };
 
+    enum class texture_filter {
+        nearest,
+        bilinear,
+        trilinear,  // Bilinear, blended between the two closest mip levels.
+    };
+
+    enum class texture_wrap {
+        repeat,
+        clamp,
+    };
+
+    // How a texture's texels are stored.
+    enum class texture_format {
+        rgba8,  // 4 bytes per texel.
+        bc1,    // Blocks of 4x4 texels in 8 bytes. Opaque, the alpha of the image is dropped.
+        bc3,    // Blocks of 4x4 texels in 16 bytes, 8 for colors like BC1 and 8 for alpha.
+    };
+
+    /*
+     * RGBA texture with a precomputed mip chain, each level half the size of the previous one down to 1x1.
+     *
+     * The level of detail picks the mip level: 0 samples the first level, 1 the second and so on. Texture
+     * coordinates outside of [0, 1] repeat or are clamped, depending on the wrap mode.
+     *
+     * Block compressed textures are encoded once when they're created and the texels a sample needs are
+     * decoded while sampling, the texture is never decompressed as a whole.
+     */
+    class texture {
+    public:
+        struct level {
+            i32 width;
+            i32 height;
+            bool is_power_of_two;
+            std::vector<color_rgba> texels;  // Only for rgba8.
+            std::vector<u64> blocks;         // Only for bc1 and bc3, row by row.
+        };
+
+        texture_filter filter = texture_filter::trilinear;
+        texture_wrap wrap     = texture_wrap::repeat;
+
+        texture() = default;
+        // With premultiply_alpha the texels are premultiplied once here, before the levels are built.
+        explicit texture(const image &image, texture_format format = texture_format::rgba8,
+                         bool premultiply_alpha = false);
+        // A texture from the levels of another one, e.g. one that was saved to a file.
+        texture(std::vector<level> levels, texture_format format, bool is_premultiplied);
+
+        size_t width() const { return m_levels.empty() ? 0 : m_levels[0].width; }
+        size_t height() const { return m_levels.empty() ? 0 : m_levels[0].height; }
+        size_t level_count() const { return m_levels.size(); }
+        texture_format format() const { return m_format; }
+        bool is_premultiplied() const { return m_is_premultiplied; }
+        std::span<const level> levels() const { return m_levels; }
+
+        // Level of detail for texture coordinates that change by 2^tex_coord_scale per pixel.
+        f32 level_of_detail(f32 tex_coord_scale) const { return tex_coord_scale + m_log2_size; }
+
+        color_rgba sample(vec2f tex_coord, f32 level_of_detail = 0.0f) const;
+
+        // Size in bytes of all levels.
+        size_t data_size() const;
+
+    private:
+        std::vector<level> m_levels;
+        texture_format m_format = texture_format::rgba8;
+        bool m_is_premultiplied = false;
+        f32 m_log2_size         = 0.0f;
+
+        // The texel at x, y of a level, decoded from its block if the texture is compressed.
+        color_rgba texel(const level &level, i32 x, i32 y) const;
+
+        color_rgba sample_nearest(const level &level, vec2f tex_coord) const;
+        color_rgba sample_bilinear(const level &level, vec2f tex_coord) const;
+    };
+
     struct blit_image_params {
         vec2<size_t> dst;
         rect<size_t> src;
-        const image &image;
+        const vlk::image &image;
         color_buffer &color_buf;
+        blend_mode blend = blend_mode::alpha;
     };
 
     void blit_image(const blit_image_params &params);
 
+    enum class resample_filter {
+        nearest,
+        integer,  // Nearest with the largest whole number scale that fits, at least 1, centered.
+        bilinear
+    };
+
+    struct resample_buffer_params {
+        const color_buffer &src;
+        color_buffer &dst;
+        resample_filter filter = resample_filter::bilinear;
+
+        // Resample bands of rows in parallel.
+        bool multithreaded = true;
+    };
+
+    /*
+     * Scale src to cover dst and replace its pixels, e.g. to present a low resolution render target in a
+     * window. Bilinear filtering clamps to the edges of src.
+     *
+     * NOTE: With resample_filter::integer the pixels of dst around the scaled src are left as they are, and
+     *       src is cropped to its top left if it doesn't fit.
+     */
+    void resample_buffer(const resample_buffer_params &params);
+
     struct model {
         struct material {
             std::string name;
@@ -236,8 +736,27 @@ namespace vlk {
         std::vector<mesh> meshes;
         std::vector<material> materials;
         std::vector<image> images;
+        std::vector<texture> textures;  // Built from images, at the same indices. See also load_obj().
 
         static constexpr size_t null_index = static_cast<size_t>(-1);
+
+        // Total bytes of model data copied by model's copy constructor and copy assignment. Meant for
+        // debugging, e.g. to check that a draw call doesn't copy the model it draws.
+        inline static std::atomic<size_t> copied_bytes = 0;
+
+        model() = default;
+        model(const model &other);
+        model(model &&other) = default;
+
+        model &operator=(const model &other);
+        model &operator=(model &&other) = default;
+
+        // Size in bytes of the geometry, materials and images.
+        size_t data_size() const;
+
+        // Replace textures with textures built from images. Compressed textures are BC1 for opaque images
+        // and BC3 otherwise, and images is cleared then.
+        void build_textures(bool compress, bool premultiply_alpha);
     };
 
     using model_pixel_shader_func =
@@ -245,17 +764,37 @@ namespace vlk {
 
     color_rgba default_model_pixel_shader(const vertex &vertex, const model &model, size_t material_index);
 
-    struct render_model_params {
-        model model;
+    // Function object version of default_model_pixel_shader().
+    struct default_model_pixel_shader_op {
+        color_rgba operator()(const vertex &vertex, const model &model, size_t material_index) const {
+            return default_model_pixel_shader(vertex, model, material_index);
+        }
+    };
+
+    template <typename PixelShader = default_model_pixel_shader_op,
+              typename ColorBlend  = default_color_blend_op>
+    struct basic_render_model_params {
+        const vlk::model &model;  // Not copied, must outlive the draw call.
         mat4 mvp_matrix;
         mat3 normal_matrix;
 
         std::array<vertex, 3> vertices;
         optional_ref<color_buffer> color_buf;
         optional_ref<depth_buffer> depth_buf;
-        model_pixel_shader_func pixel_shader = default_model_pixel_shader;
-        color_blend_func color_blend         = default_color_blend;
+        PixelShader pixel_shader = default_model_pixel_shader_op{};
+        ColorBlend color_blend   = default_color_blend_op{};
+        cull_mode cull           = cull_mode::none;
+
+        // See basic_render_triangles_params::multithreaded.
+        bool multithreaded = false;
     };
 
+    using render_model_params = basic_render_model_params<model_pixel_shader_func, color_blend_func>;
+
+    template <typename PixelShader, typename ColorBlend>
+    void render_model(const basic_render_model_params<PixelShader, ColorBlend> &params);
+
     void render_model(const render_model_params &params);
 }  // namespace vlk
+
+#include "vlk.raster.hpp"
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "vlk.util.hpp"
 #include "vlk.vec.hpp"
 #include "vlk.math.hpp"
+#include "vlk.pixels.hpp"
 #include "vlk.gfx.hpp"
+#include "vlk.image_decoder.hpp"
 #include "vlk.physics.hpp"
 #include "vlk.system.hpp"
\ No newline at end of file
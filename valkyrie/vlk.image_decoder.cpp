@@ -0,0 +1,1826 @@
+#include "vlk.image_decoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "vlk.pixels.hpp"
+
+using namespace vlk;
+
+[[noreturn]] static void decode_error(std::string_view format, std::string_view message) {
+    throw std::runtime_error(std::format("Valkyrie: failed to decode {} image: {}.", format, message));
+}
+
+// Bounds checked reads of the integers in a file.
+class byte_reader {
+public:
+    byte_reader(std::span<const u8> data, std::string_view format) : m_data{data}, m_format{format} {}
+
+    std::span<const u8> bytes(size_t offset, size_t size) const {
+        if (offset > m_data.size() || size > m_data.size() - offset) {
+            decode_error(m_format, "unexpected end of file");
+        }
+
+        return m_data.subspan(offset, size);
+    }
+
+    u8 u8_at(size_t offset) const { return bytes(offset, 1)[0]; }
+
+    u16 u16_le(size_t offset) const {
+        const auto b = bytes(offset, 2);
+        return static_cast<u16>(b[0] | b[1] << 8);
+    }
+
+    u32 u32_le(size_t offset) const {
+        const auto b = bytes(offset, 4);
+        return b[0] | b[1] << 8 | b[2] << 16 | static_cast<u32>(b[3]) << 24;
+    }
+
+    u16 u16_be(size_t offset) const {
+        const auto b = bytes(offset, 2);
+        return static_cast<u16>(b[0] << 8 | b[1]);
+    }
+
+    u32 u32_be(size_t offset) const {
+        const auto b = bytes(offset, 4);
+        return static_cast<u32>(b[0]) << 24 | b[1] << 16 | b[2] << 8 | b[3];
+    }
+
+private:
+    std::span<const u8> m_data;
+    std::string_view m_format;
+};
+
+// Larger images are taken to be corrupt files rather than allocated.
+static void check_image_size(size_t width, size_t height, std::string_view format) {
+    constexpr size_t max_side   = size_t{1} << 24;
+    constexpr size_t max_pixels = size_t{1} << 28;
+
+    if (width == 0 || height == 0 || width > max_side || height > max_side || width * height > max_pixels) {
+        decode_error(format, "invalid image size");
+    }
+}
+
+// The row of image that row y of the file goes to.
+static u8 *image_row(image &image, size_t y, bool flip_vertically) {
+    const size_t row = flip_vertically ? image.height() - 1 - y : y;
+    return image.data().data() + row * image.width() * 4;
+}
+
+/*
+ * Inflate (RFC 1950 and 1951), for the image data of PNG files.
+ */
+
+static constexpr std::array<u8, 8> png_signature{0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+static u32 reverse_bits(u32 bits, u32 count) {
+    u32 reversed = 0;
+
+    for (u32 i = 0; i < count; ++i) {
+        reversed = reversed << 1 | (bits >> i & 1);
+    }
+
+    return reversed;
+}
+
+// Deflate bits are read starting at the least significant bit of each byte.
+class deflate_bits {
+public:
+    deflate_bits(std::span<const u8> data) : m_data{data} {}
+
+    // Past the end of the data zeros are read, overrun() tells if any were used.
+    void refill() {
+        while (m_count <= 56) {
+            const u64 byte = m_pos < m_data.size() ? m_data[m_pos] : 0;
+
+            m_bits |= byte << m_count;
+            m_count += 8;
+            ++m_pos;
+        }
+    }
+
+    u32 peek(u32 count) const { return static_cast<u32>(m_bits & ((u64{1} << count) - 1)); }
+
+    void consume(u32 count) {
+        m_bits >>= count;
+        m_count -= count;
+    }
+
+    u32 read(u32 count) {
+        refill();
+
+        const u32 bits = peek(count);
+        consume(count);
+
+        return bits;
+    }
+
+    void align_to_byte() { consume(m_count % 8); }
+
+    bool overrun() const { return m_pos - m_count / 8 > m_data.size(); }
+
+private:
+    std::span<const u8> m_data;
+    size_t m_pos = 0;
+
+    u64 m_bits   = 0;
+    u32 m_count = 0;
+};
+
+// Canonical Huffman code of deflate. Codes up to fast_bits long are decoded with a single table lookup.
+class deflate_huffman {
+public:
+    static constexpr u32 fast_bits = 9;
+
+    void build(std::span<const u8> lengths) {
+        std::array<u32, 16> counts{};
+
+        for (const u8 length : lengths) {
+            ++counts[length];
+        }
+        counts[0] = 0;
+
+        m_fast.fill(0);
+
+        std::array<u32, 16> next_code{};
+        u32 code   = 0;
+        u32 symbol = 0;
+
+        for (u32 length = 1; length < 16; ++length) {
+            next_code[length]      = code;
+            m_first_code[length]   = code;
+            m_first_symbol[length] = symbol;
+
+            code += counts[length];
+
+            if (counts[length] != 0 && code - 1 >= (1u << length)) {
+                decode_error("PNG", "invalid Huffman code lengths");
+            }
+
+            m_max_code[length] = code << (16 - length);
+
+            code <<= 1;
+            symbol += counts[length];
+        }
+
+        m_max_code[16] = 1 << 16;
+
+        for (u32 i = 0; i < lengths.size(); ++i) {
+            const u32 length = lengths[i];
+
+            if (length == 0) {
+                continue;
+            }
+
+            const u32 index = next_code[length] - m_first_code[length] + m_first_symbol[length];
+
+            m_lengths[index] = static_cast<u8>(length);
+            m_symbols[index] = static_cast<u16>(i);
+
+            if (length <= fast_bits) {
+                for (u32 j = reverse_bits(next_code[length], length); j < m_fast.size(); j += 1u << length) {
+                    m_fast[j] = static_cast<u16>(length << 9 | i);
+                }
+            }
+
+            ++next_code[length];
+        }
+    }
+
+    u32 decode(deflate_bits &bits) const {
+        bits.refill();
+
+        const u32 entry = m_fast[bits.peek(fast_bits)];
+
+        if (entry != 0) {
+            bits.consume(entry >> 9);
+            return entry & 511;
+        }
+
+        // Longer codes, compared most significant bit first like they were assigned.
+        const u32 code = reverse_bits(bits.peek(16), 16);
+        u32 length     = fast_bits + 1;
+
+        while (code >= m_max_code[length]) {
+            ++length;
+        }
+
+        const u32 index = (code >> (16 - length)) - m_first_code[length] + m_first_symbol[length];
+
+        if (length == 16 || index >= m_lengths.size() || m_lengths[index] != length) {
+            decode_error("PNG", "invalid Huffman code");
+        }
+
+        bits.consume(length);
+
+        return m_symbols[index];
+    }
+
+private:
+    std::array<u16, 1 << fast_bits> m_fast;  // Length << 9 | symbol, 0 for longer codes.
+
+    std::array<u32, 17> m_first_code;
+    std::array<u32, 17> m_first_symbol;
+    std::array<u32, 17> m_max_code;  // One past the last code of each length, as 16 bits.
+
+    std::array<u8, 288> m_lengths;
+    std::array<u16, 288> m_symbols;
+};
+
+// Inflates a zlib stream into out, which has to be exactly as large as the inflated data.
+static void inflate(std::span<const u8> data, std::span<u8> out) {
+    static constexpr std::array<u16, 29> length_base{3,  4,  5,  6,  7,  8,  9,  10,  11,  13,
+                                                     15, 17, 19, 23, 27, 31, 35, 43,  51,  59,
+                                                     67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static constexpr std::array<u8, 29> length_extra{0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                     2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static constexpr std::array<u16, 30> distance_base{1,    2,    3,    4,    5,    7,     9,     13,
+                                                       17,   25,   33,   49,   65,   97,    129,   193,
+                                                       257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                                       4097, 6145, 8193, 12289, 16385, 24577};
+    static constexpr std::array<u8, 30> distance_extra{0, 0, 0, 0, 1, 1, 2,  2,  3,  3,  4,  4,  5,  5,  6,
+                                                       6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    static constexpr std::array<u8, 19> code_length_order{16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                          11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+    if (data.size() < 2 || (data[0] & 15) != 8 || (data[0] << 8 | data[1]) % 31 != 0) {
+        decode_error("PNG", "invalid zlib header");
+    }
+    if (data[1] & 32) {
+        decode_error("PNG", "zlib preset dictionaries are not supported");
+    }
+
+    deflate_bits bits{data.subspan(2)};
+    deflate_huffman literals;
+    deflate_huffman distances;
+
+    size_t pos = 0;
+
+    for (bool is_final = false; !is_final;) {
+        is_final        = bits.read(1) != 0;
+        const u32 type = bits.read(2);
+
+        if (type == 0) {
+            bits.align_to_byte();
+
+            const u32 length = bits.read(16);
+
+            if ((bits.read(16) ^ 0xffff) != length || length > out.size() - pos) {
+                decode_error("PNG", "invalid stored block");
+            }
+
+            for (u32 i = 0; i < length; ++i) {
+                out[pos++] = static_cast<u8>(bits.read(8));
+            }
+        } else if (type == 1 || type == 2) {
+            std::array<u8, 288 + 32> lengths{};
+            u32 literal_count  = 288;
+            u32 distance_count = 32;
+
+            if (type == 1) {
+                std::fill(lengths.begin(), lengths.begin() + 144, u8{8});
+                std::fill(lengths.begin() + 144, lengths.begin() + 256, u8{9});
+                std::fill(lengths.begin() + 256, lengths.begin() + 280, u8{7});
+                std::fill(lengths.begin() + 280, lengths.begin() + 288, u8{8});
+                std::fill(lengths.begin() + 288, lengths.end(), u8{5});
+            } else {
+                literal_count                 = bits.read(5) + 257;
+                distance_count                = bits.read(5) + 1;
+                const u32 code_length_count = bits.read(4) + 4;
+
+                std::array<u8, 19> code_lengths{};
+
+                for (u32 i = 0; i < code_length_count; ++i) {
+                    code_lengths[code_length_order[i]] = static_cast<u8>(bits.read(3));
+                }
+
+                deflate_huffman code_length_code;
+                code_length_code.build(code_lengths);
+
+                u8 previous = 0;
+
+                for (u32 i = 0; i < literal_count + distance_count;) {
+                    const u32 symbol = code_length_code.decode(bits);
+
+                    u32 repeat = 1;
+                    u8 length  = static_cast<u8>(symbol);
+
+                    if (symbol == 16) {
+                        if (i == 0) {
+                            decode_error("PNG", "invalid code lengths");
+                        }
+
+                        repeat = bits.read(2) + 3;
+                        length = previous;
+                    } else if (symbol == 17) {
+                        repeat = bits.read(3) + 3;
+                        length = 0;
+                    } else if (symbol == 18) {
+                        repeat = bits.read(7) + 11;
+                        length = 0;
+                    }
+
+                    if (repeat > literal_count + distance_count - i) {
+                        decode_error("PNG", "invalid code lengths");
+                    }
+
+                    // The distance lengths follow the literal lengths, and are kept from index 288 on.
+                    for (; repeat > 0; --repeat, ++i) {
+                        lengths[i < literal_count ? i : 288 + i - literal_count] = length;
+                    }
+
+                    previous = length;
+                }
+
+                if (lengths[256] == 0) {
+                    decode_error("PNG", "missing end of block code");
+                }
+            }
+
+            literals.build({lengths.data(), literal_count});
+            distances.build({lengths.data() + 288, distance_count});
+
+            while (true) {
+                const u32 symbol = literals.decode(bits);
+
+                if (symbol < 256) {
+                    if (pos == out.size()) {
+                        decode_error("PNG", "too much image data");
+                    }
+
+                    out[pos++] = static_cast<u8>(symbol);
+                    continue;
+                }
+
+                if (symbol == 256) {
+                    break;
+                }
+
+                if (symbol - 257 >= length_base.size()) {
+                    decode_error("PNG", "invalid length code");
+                }
+
+                const u32 length          = length_base[symbol - 257] + bits.read(length_extra[symbol - 257]);
+                const u32 distance_symbol = distances.decode(bits);
+
+                if (distance_symbol >= distance_base.size()) {
+                    decode_error("PNG", "invalid distance code");
+                }
+
+                const u32 distance =
+                    distance_base[distance_symbol] + bits.read(distance_extra[distance_symbol]);
+
+                if (distance > pos || length > out.size() - pos) {
+                    decode_error("PNG", "invalid distance");
+                }
+
+                u8 *dst       = out.data() + pos;
+                const u8 *src = dst - distance;
+
+                // Overlapping copies repeat the last distance bytes.
+                if (distance >= length) {
+                    std::memcpy(dst, src, length);
+                } else {
+                    for (u32 i = 0; i < length; ++i) {
+                        dst[i] = src[i];
+                    }
+                }
+
+                pos += length;
+            }
+        } else {
+            decode_error("PNG", "invalid block type");
+        }
+
+        if (bits.overrun()) {
+            decode_error("PNG", "unexpected end of image data");
+        }
+    }
+
+    if (pos != out.size()) {
+        decode_error("PNG", "not enough image data");
+    }
+}
+
+/*
+ * PNG
+ */
+
+struct png_info {
+    u32 width;
+    u32 height;
+    u32 bit_depth;
+    u32 color_type;
+    u32 channels;
+
+    std::array<std::array<u8, 4>, 256> palette;  // RGBA.
+
+    // Gray or RGB samples of the transparent color, at the bit depth of the image.
+    bool has_transparent_color = false;
+    std::array<u32, 3> transparent_color{};
+};
+
+// Adam7 passes, the pixels at x, y + n * step.
+struct png_pass {
+    u32 x;
+    u32 y;
+    u32 step_x;
+    u32 step_y;
+};
+
+static constexpr std::array<png_pass, 7> adam7_passes{
+    {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4}, {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}}
+};
+
+static void unfilter_png_row(u8 filter, std::span<u8> row, std::span<const u8> previous, size_t pixel_size) {
+    switch (filter) {
+        case 0:
+            break;
+
+        case 1:
+            for (size_t i = pixel_size; i < row.size(); ++i) {
+                row[i] = static_cast<u8>(row[i] + row[i - pixel_size]);
+            }
+            break;
+
+        case 2:
+            for (size_t i = 0; i < row.size(); ++i) {
+                row[i] = static_cast<u8>(row[i] + previous[i]);
+            }
+            break;
+
+        case 3:
+            for (size_t i = 0; i < row.size(); ++i) {
+                const u32 left = i >= pixel_size ? row[i - pixel_size] : 0;
+                row[i]         = static_cast<u8>(row[i] + (left + previous[i]) / 2);
+            }
+            break;
+
+        case 4:
+            for (size_t i = 0; i < row.size(); ++i) {
+                const i32 a = i >= pixel_size ? row[i - pixel_size] : 0;
+                const i32 b = previous[i];
+                const i32 c = i >= pixel_size ? previous[i - pixel_size] : 0;
+
+                const i32 pa = std::abs(b - c);
+                const i32 pb = std::abs(a - c);
+                const i32 pc = std::abs(a + b - 2 * c);
+
+                row[i] = static_cast<u8>(row[i] + (pa <= pb && pa <= pc ? a : pb <= pc ? b : c));
+            }
+            break;
+
+        default:
+            decode_error("PNG", "invalid filter type");
+    }
+}
+
+// Sample i of a row at the bit depth of the image.
+static u32 png_sample(const u8 *row, size_t i, u32 bit_depth) {
+    if (bit_depth == 8) {
+        return row[i];
+    }
+    if (bit_depth == 16) {
+        return static_cast<u32>(row[i * 2] << 8 | row[i * 2 + 1]);
+    }
+
+    const size_t bit = i * bit_depth;
+    return (row[bit / 8] >> (8 - bit_depth - bit % 8)) & ((1u << bit_depth) - 1);
+}
+
+static u8 png_sample_to_u8(u32 sample, u32 bit_depth) {
+    if (bit_depth == 16) {
+        return static_cast<u8>(sample >> 8);
+    }
+
+    return static_cast<u8>(sample * 255 / ((1u << bit_depth) - 1));
+}
+
+static void convert_png_row(std::span<u8> dst, const u8 *row, size_t width, const png_info &png) {
+    const u32 depth = png.bit_depth;
+
+    // The common formats without transparent colors are whole rows of conversions.
+    if (depth == 8 && png.color_type == 6) {
+        std::memcpy(dst.data(), row, width * 4);
+        return;
+    }
+    if (depth == 8 && png.color_type == 2 && !png.has_transparent_color) {
+        convert_rgb_to_rgba(dst, {row, width * 3});
+        return;
+    }
+
+    for (size_t x = 0; x < width; ++x) {
+        u8 *pixel = dst.data() + x * 4;
+
+        switch (png.color_type) {
+            case 0: {
+                const u32 gray = png_sample(row, x, depth);
+                const u8 value = png_sample_to_u8(gray, depth);
+
+                pixel[0] = pixel[1] = pixel[2] = value;
+                pixel[3] = png.has_transparent_color && gray == png.transparent_color[0] ? 0 : 255;
+                break;
+            }
+
+            case 2: {
+                std::array<u32, 3> rgb;
+
+                for (size_t c = 0; c < 3; ++c) {
+                    rgb[c]   = png_sample(row, x * 3 + c, depth);
+                    pixel[c] = png_sample_to_u8(rgb[c], depth);
+                }
+                pixel[3] = png.has_transparent_color && rgb == png.transparent_color ? 0 : 255;
+                break;
+            }
+
+            case 3:
+                std::memcpy(pixel, png.palette[png_sample(row, x, depth)].data(), 4);
+                break;
+
+            case 4:
+                pixel[0] = pixel[1] = pixel[2] = png_sample_to_u8(png_sample(row, x * 2, depth), depth);
+                pixel[3] = png_sample_to_u8(png_sample(row, x * 2 + 1, depth), depth);
+                break;
+
+            case 6:
+                for (size_t c = 0; c < 4; ++c) {
+                    pixel[c] = png_sample_to_u8(png_sample(row, x * 4 + c, depth), depth);
+                }
+                break;
+        }
+    }
+}
+
+static image decode_png(std::span<const u8> data, bool flip_vertically) {
+    const byte_reader reader{data, "PNG"};
+
+    png_info png{};
+    bool has_header = false;
+    u32 interlace   = 0;
+
+    for (auto &color : png.palette) {
+        color = {0, 0, 0, 255};
+    }
+
+    std::vector<u8> compressed;
+
+    for (size_t pos = png_signature.size();;) {
+        const u32 length             = reader.u32_be(pos);
+        const auto type              = reader.bytes(pos + 4, 4);
+        const std::span<const u8> chunk = reader.bytes(pos + 8, length);
+        const std::string_view name{reinterpret_cast<const char *>(type.data()), type.size()};
+
+        pos += 12 + size_t{length};
+
+        if (name == "IHDR") {
+            if (length < 13) {
+                decode_error("PNG", "invalid header");
+            }
+
+            png.width      = reader.u32_be(pos - length - 4);
+            png.height     = reader.u32_be(pos - length);
+            png.bit_depth  = chunk[8];
+            png.color_type = chunk[9];
+            interlace      = chunk[12];
+
+            const u32 depth         = png.bit_depth;
+            const bool valid_depth = depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+
+            switch (png.color_type) {
+                case 0: png.channels = valid_depth ? 1 : 0; break;
+                case 2: png.channels = depth >= 8 ? 3 : 0; break;
+                case 3: png.channels = valid_depth && depth <= 8 ? 1 : 0; break;
+                case 4: png.channels = depth >= 8 ? 2 : 0; break;
+                case 6: png.channels = depth >= 8 ? 4 : 0; break;
+            }
+
+            if (png.channels == 0 || !valid_depth || chunk[10] != 0 || chunk[11] != 0 || interlace > 1) {
+                decode_error("PNG", "invalid header");
+            }
+
+            check_image_size(png.width, png.height, "PNG");
+            has_header = true;
+        } else if (!has_header) {
+            decode_error("PNG", "missing header");
+        } else if (name == "PLTE") {
+            if (length % 3 != 0 || length / 3 > png.palette.size()) {
+                decode_error("PNG", "invalid palette");
+            }
+
+            for (size_t i = 0; i < length / 3; ++i) {
+                png.palette[i] = {chunk[i * 3], chunk[i * 3 + 1], chunk[i * 3 + 2], 255};
+            }
+        } else if (name == "tRNS") {
+            if (png.color_type == 3) {
+                for (size_t i = 0; i < std::min<size_t>(length, png.palette.size()); ++i) {
+                    png.palette[i][3] = chunk[i];
+                }
+            } else if ((png.color_type == 0 && length >= 2) || (png.color_type == 2 && length >= 6)) {
+                png.has_transparent_color = true;
+
+                for (size_t c = 0; c < (png.color_type == 0 ? 1 : 3); ++c) {
+                    png.transparent_color[c] = static_cast<u32>(chunk[c * 2] << 8 | chunk[c * 2 + 1]);
+                }
+            }
+        } else if (name == "IDAT") {
+            compressed.insert(compressed.end(), chunk.begin(), chunk.end());
+        } else if (name == "IEND") {
+            break;
+        } else if ((type[0] & 32) == 0) {
+            // Chunks that start with an uppercase letter can't be ignored.
+            decode_error("PNG", std::format("unsupported chunk {}", name));
+        }
+    }
+
+    if (!has_header) {
+        decode_error("PNG", "missing header");
+    }
+
+    const size_t bits_per_pixel = png.channels * png.bit_depth;
+    const size_t pixel_size     = std::max<size_t>(bits_per_pixel / 8, 1);
+
+    const std::span<const png_pass> passes =
+        interlace == 1 ? std::span<const png_pass>{adam7_passes} : std::span<const png_pass>{};
+    constexpr png_pass whole_image{0, 0, 1, 1};
+
+    struct pass_size {
+        size_t width;
+        size_t height;
+        size_t row_size;
+    };
+
+    std::vector<pass_size> pass_sizes;
+    size_t filtered_size = 0;
+
+    for (const png_pass &pass : passes.empty() ? std::span<const png_pass>{&whole_image, 1} : passes) {
+        const size_t width  = png.width > pass.x ? (png.width - pass.x + pass.step_x - 1) / pass.step_x : 0;
+        const size_t height = png.height > pass.y ? (png.height - pass.y + pass.step_y - 1) / pass.step_y : 0;
+
+        // Empty passes have no filter bytes either.
+        const size_t row_size = (width * bits_per_pixel + 7) / 8;
+
+        pass_sizes.push_back({width, height, row_size});
+        filtered_size += width == 0 ? 0 : height * (row_size + 1);
+    }
+
+    std::vector<u8> filtered(filtered_size);
+    inflate(compressed, filtered);
+
+    image result{png.width, png.height, 4};
+
+    std::vector<u8> zero_row((png.width * bits_per_pixel + 7) / 8);
+    std::vector<u8> pass_row(passes.empty() ? 0 : png.width * 4);
+
+    u8 *row = filtered.data();
+
+    for (size_t p = 0; p < pass_sizes.size(); ++p) {
+        const auto [width, height, row_size] = pass_sizes[p];
+
+        if (width == 0) {
+            continue;
+        }
+
+        const u8 *previous = zero_row.data();
+
+        for (size_t y = 0; y < height; ++y) {
+            unfilter_png_row(row[0], {row + 1, row_size}, {previous, row_size}, pixel_size);
+
+            if (passes.empty()) {
+                convert_png_row({image_row(result, y, flip_vertically), width * 4}, row + 1, width, png);
+            } else {
+                const png_pass &pass = passes[p];
+
+                convert_png_row({pass_row.data(), width * 4}, row + 1, width, png);
+
+                u8 *dst = image_row(result, pass.y + y * pass.step_y, flip_vertically);
+
+                for (size_t x = 0; x < width; ++x) {
+                    std::memcpy(dst + (pass.x + x * pass.step_x) * 4, pass_row.data() + x * 4, 4);
+                }
+            }
+
+            previous = row + 1;
+            row += row_size + 1;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Baseline JPEG (ITU T.81), sequential with Huffman coding and 8-bit samples.
+ */
+
+// The natural order index of each coefficient in zigzag order.
+static constexpr std::array<u8, 64> jpeg_zigzag{
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// Scale factors of the AAN IDCT, cos(k * pi / 16) * sqrt(2) and 1 for k = 0.
+static constexpr std::array<f32, 8> aan_scales{1.0f,         1.387039845f, 1.306562965f, 1.175875602f,
+                                               1.0f,         0.785694958f, 0.541196100f, 0.275899379f};
+
+// Start of frame markers, of every coding process.
+static bool is_frame_marker(u8 marker) {
+    return marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+}
+
+// JPEG bits are read starting at the most significant bit, 0xff bytes are followed by a 0 byte that is
+// skipped. The entropy coded data ends at a marker, after which zeros are read.
+class jpeg_bits {
+public:
+    jpeg_bits(std::span<const u8> data, size_t pos) : m_data{data}, m_pos{pos} {}
+
+    void refill() {
+        while (m_count <= 24) {
+            u32 byte = 0;
+
+            if (!m_at_marker && m_pos < m_data.size()) {
+                byte = m_data[m_pos];
+
+                if (byte != 0xff) {
+                    ++m_pos;
+                } else if (m_pos + 1 < m_data.size() && m_data[m_pos + 1] == 0) {
+                    m_pos += 2;
+                } else {
+                    m_at_marker = true;
+                    byte        = 0;
+                }
+            }
+
+            m_bits |= byte << (24 - m_count);
+            m_count += 8;
+        }
+    }
+
+    u32 peek(u32 count) const { return m_bits >> (32 - count); }
+
+    void consume(u32 count) {
+        m_bits <<= count;
+        m_count -= count;
+    }
+
+    // Reads a count bit value of a coefficient, the values starting with a 0 bit are negative.
+    i32 receive_extend(u32 count) {
+        if (count == 0) {
+            return 0;
+        }
+
+        refill();
+
+        const i32 value = static_cast<i32>(peek(count));
+        consume(count);
+
+        return value < (1 << (count - 1)) ? value - (1 << count) + 1 : value;
+    }
+
+    // Skips to after the next restart marker and starts reading from there.
+    void restart() {
+        m_bits      = 0;
+        m_count     = 0;
+        m_at_marker = false;
+
+        while (m_pos + 1 < m_data.size() &&
+               !(m_data[m_pos] == 0xff && m_data[m_pos + 1] >= 0xd0 && m_data[m_pos + 1] <= 0xd7)) {
+            ++m_pos;
+        }
+
+        m_pos = std::min(m_pos + 2, m_data.size());
+    }
+
+    // Where the entropy coded data ended, or where reading stopped if it didn't.
+    size_t position() const { return m_pos; }
+
+private:
+    std::span<const u8> m_data;
+    size_t m_pos;
+
+    u32 m_bits       = 0;
+    u32 m_count      = 0;
+    bool m_at_marker = false;
+};
+
+// Canonical Huffman code of JPEG. Codes up to fast_bits long are decoded with a single table lookup.
+class jpeg_huffman {
+public:
+    static constexpr u32 fast_bits = 9;
+
+    bool is_defined() const { return m_is_defined; }
+
+    void build(std::span<const u8, 16> counts, std::span<const u8> symbols) {
+        m_fast.fill(0);
+        std::copy(symbols.begin(), symbols.end(), m_symbols.begin());
+        m_symbol_count = symbols.size();
+
+        u32 code  = 0;
+        u32 index = 0;
+
+        for (u32 length = 1; length <= 16; ++length) {
+            m_index_offset[length] = static_cast<i32>(index) - static_cast<i32>(code);
+
+            // Checked before the codes are added, as more than fit would be written past the end of m_fast.
+            if (code + counts[length - 1] > (1u << length)) {
+                decode_error("JPEG", "invalid Huffman table");
+            }
+
+            for (u32 i = 0; i < counts[length - 1]; ++i, ++code, ++index) {
+                if (length <= fast_bits) {
+                    const u32 shift = fast_bits - length;
+
+                    for (u32 j = code << shift; j < (code + 1) << shift; ++j) {
+                        m_fast[j] = static_cast<u16>(length << 8 | m_symbols[index]);
+                    }
+                }
+            }
+
+            m_max_code[length] = counts[length - 1] != 0 ? static_cast<i32>(code) - 1 : -1;
+            code <<= 1;
+        }
+
+        m_is_defined = true;
+    }
+
+    u32 decode(jpeg_bits &bits) const {
+        bits.refill();
+
+        const u32 entry = m_fast[bits.peek(fast_bits)];
+
+        if (entry != 0) {
+            bits.consume(entry >> 8);
+            return entry & 255;
+        }
+
+        for (u32 length = fast_bits + 1; length <= 16; ++length) {
+            const i32 code = static_cast<i32>(bits.peek(length));
+
+            if (code <= m_max_code[length]) {
+                const size_t index = static_cast<size_t>(code + m_index_offset[length]);
+
+                if (index >= m_symbol_count) {
+                    break;
+                }
+
+                bits.consume(length);
+                return m_symbols[index];
+            }
+        }
+
+        decode_error("JPEG", "invalid Huffman code");
+    }
+
+private:
+    std::array<u16, 1 << fast_bits> m_fast;  // Length << 8 | symbol, 0 for longer codes.
+
+    std::array<i32, 17> m_max_code{};      // The last code of each length, -1 if there are none.
+    std::array<i32, 17> m_index_offset{};  // Index into symbols of a code minus the code.
+
+    std::array<u8, 256> m_symbols{};
+    size_t m_symbol_count = 0;
+    bool m_is_defined     = false;
+};
+
+#if defined(VLK_SSE2)
+// Four floats with arithmetic operators, so the IDCT can be written once for floats and vectors.
+struct f32x4 {
+    __m128 v;
+};
+
+static f32x4 operator+(f32x4 a, f32x4 b) { return {_mm_add_ps(a.v, b.v)}; }
+static f32x4 operator-(f32x4 a, f32x4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+static f32x4 operator*(f32x4 a, f32 b) { return {_mm_mul_ps(a.v, _mm_set1_ps(b))}; }
+#endif
+
+/*
+ * 8-point IDCT of the AAN algorithm, in place, as in the float IDCT of the IJG's libjpeg. The inputs are
+ * scaled by aan_scales, which is folded into the quantization tables.
+ */
+template <typename T>
+static void idct_8(std::array<T, 8> &v) {
+    // Even part.
+    T tmp10 = v[0] + v[4];
+    T tmp11 = v[0] - v[4];
+    T tmp13 = v[2] + v[6];
+    T tmp12 = (v[2] - v[6]) * 1.414213562f - tmp13;
+
+    const T tmp0 = tmp10 + tmp13;
+    const T tmp3 = tmp10 - tmp13;
+    const T tmp1 = tmp11 + tmp12;
+    const T tmp2 = tmp11 - tmp12;
+
+    // Odd part.
+    const T z13 = v[5] + v[3];
+    const T z10 = v[5] - v[3];
+    const T z11 = v[1] + v[7];
+    const T z12 = v[1] - v[7];
+
+    const T tmp7 = z11 + z13;
+    tmp11        = (z11 - z13) * 1.414213562f;
+
+    const T z5 = (z10 + z12) * 1.847759065f;
+    tmp10      = z5 - z12 * 1.082392200f;
+    tmp12      = z5 - z10 * 2.613125930f;
+
+    const T tmp6 = tmp12 - tmp7;
+    const T tmp5 = tmp11 - tmp6;
+    const T tmp4 = tmp10 - tmp5;
+
+    v[0] = tmp0 + tmp7;
+    v[7] = tmp0 - tmp7;
+    v[1] = tmp1 + tmp6;
+    v[6] = tmp1 - tmp6;
+    v[2] = tmp2 + tmp5;
+    v[5] = tmp2 - tmp5;
+    v[3] = tmp3 + tmp4;
+    v[4] = tmp3 - tmp4;
+}
+
+#if defined(VLK_SSE2)
+// An 8x8 block as its left and right four columns.
+static void transpose_8x8(std::array<f32x4, 8> &left, std::array<f32x4, 8> &right) {
+    _MM_TRANSPOSE4_PS(left[0].v, left[1].v, left[2].v, left[3].v);
+    _MM_TRANSPOSE4_PS(left[4].v, left[5].v, left[6].v, left[7].v);
+    _MM_TRANSPOSE4_PS(right[0].v, right[1].v, right[2].v, right[3].v);
+    _MM_TRANSPOSE4_PS(right[4].v, right[5].v, right[6].v, right[7].v);
+
+    for (size_t i = 0; i < 4; ++i) {
+        std::swap(right[i], left[i + 4]);
+    }
+}
+#endif
+
+// Dequantizes a block of coefficients in natural order and writes its 8x8 samples to dst.
+static void idct_block(const std::array<i32, 64> &coefficients, const std::array<f32, 64> &quant_table,
+                       u8 *dst, size_t stride) {
+#if defined(VLK_SSE2)
+    std::array<f32x4, 8> left;
+    std::array<f32x4, 8> right;
+
+    for (size_t y = 0; y < 8; ++y) {
+        const auto *row = reinterpret_cast<const __m128i *>(coefficients.data() + y * 8);
+
+        const f32 *quant = quant_table.data() + y * 8;
+
+        left[y].v  = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(row)), _mm_loadu_ps(quant));
+        right[y].v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(row + 1)), _mm_loadu_ps(quant + 4));
+    }
+
+    // Columns, then rows of the transposed block, then back.
+    idct_8(left);
+    idct_8(right);
+    transpose_8x8(left, right);
+    idct_8(left);
+    idct_8(right);
+    transpose_8x8(left, right);
+
+    const __m128 center = _mm_set1_ps(128.0f);
+
+    for (size_t y = 0; y < 8; ++y) {
+        const __m128i lo = _mm_cvtps_epi32(_mm_add_ps(left[y].v, center));
+        const __m128i hi = _mm_cvtps_epi32(_mm_add_ps(right[y].v, center));
+
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + y * stride),
+                         _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128()));
+    }
+#else
+    std::array<f32, 64> block;
+
+    for (size_t i = 0; i < 64; ++i) {
+        block[i] = static_cast<f32>(coefficients[i]) * quant_table[i];
+    }
+
+    std::array<f32, 8> line;
+
+    for (size_t x = 0; x < 8; ++x) {
+        for (size_t y = 0; y < 8; ++y) {
+            line[y] = block[y * 8 + x];
+        }
+
+        idct_8(line);
+
+        for (size_t y = 0; y < 8; ++y) {
+            block[y * 8 + x] = line[y];
+        }
+    }
+
+    for (size_t y = 0; y < 8; ++y) {
+        std::copy_n(block.begin() + y * 8, 8, line.begin());
+        idct_8(line);
+
+        for (size_t x = 0; x < 8; ++x) {
+            dst[y * stride + x] = static_cast<u8>(std::clamp<long>(std::lrint(line[x] + 128.0f), 0, 255));
+        }
+    }
+#endif
+}
+
+static u8 round_to_u8(f32 value) {
+    return static_cast<u8>(std::clamp<long>(std::lrint(value), 0, 255));
+}
+
+static void convert_ycbcr_to_rgba(u8 *dst, const u8 *luma, const u8 *cb, const u8 *cr, size_t width) {
+    size_t x = 0;
+
+#if defined(VLK_SSE2)
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128 center  = _mm_set1_ps(128.0f);
+    const __m128i alpha  = _mm_set1_epi32(255);
+
+    auto load_4 = [&](const u8 *samples) {
+        u32 packed;
+        std::memcpy(&packed, samples, sizeof(packed));
+
+        const __m128i samples16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<i32>(packed)), zero);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(samples16, zero));
+    };
+
+    for (; x + 4 <= width; x += 4) {
+        const __m128 y  = load_4(luma + x);
+        const __m128 u  = _mm_sub_ps(load_4(cb + x), center);
+        const __m128 v  = _mm_sub_ps(load_4(cr + x), center);
+
+        const __m128 r = _mm_add_ps(y, _mm_mul_ps(v, _mm_set1_ps(1.402f)));
+        const __m128 g = _mm_sub_ps(_mm_sub_ps(y, _mm_mul_ps(u, _mm_set1_ps(0.344136f))),
+                                    _mm_mul_ps(v, _mm_set1_ps(0.714136f)));
+        const __m128 b = _mm_add_ps(y, _mm_mul_ps(u, _mm_set1_ps(1.772f)));
+
+        // Saturated to R0-3 B0-3 G0-3 A0-3, then interleaved to R0 G0 B0 A0 R1 ...
+        const __m128i rb   = _mm_packs_epi32(_mm_cvtps_epi32(r), _mm_cvtps_epi32(b));
+        const __m128i ga   = _mm_packs_epi32(_mm_cvtps_epi32(g), alpha);
+        const __m128i rbga = _mm_packus_epi16(rb, ga);
+        const __m128i rgba = _mm_unpacklo_epi8(rbga, _mm_srli_si128(rbga, 8));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                         _mm_unpacklo_epi16(rgba, _mm_srli_si128(rgba, 8)));
+    }
+#endif
+
+    for (; x < width; ++x) {
+        const f32 y = luma[x];
+        const f32 u = cb[x] - 128.0f;
+        const f32 v = cr[x] - 128.0f;
+
+        dst[x * 4 + 0] = round_to_u8(y + v * 1.402f);
+        dst[x * 4 + 1] = round_to_u8(y - u * 0.344136f - v * 0.714136f);
+        dst[x * 4 + 2] = round_to_u8(y + u * 1.772f);
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+struct jpeg_component {
+    u8 id;
+    u32 h;  // Sampling factors.
+    u32 v;
+    u32 quant_table;
+
+    u32 dc_table     = 0;
+    u32 ac_table     = 0;
+    i32 dc_predictor = 0;
+
+    // Samples that cover the image, and the blocks of the plane the samples are decoded to, which covers
+    // whole MCUs.
+    size_t width;
+    size_t height;
+    size_t blocks_x;
+    size_t blocks_y;
+
+    std::vector<u8> plane;
+};
+
+class jpeg_decoder {
+public:
+    jpeg_decoder(std::span<const u8> data) : m_data{data}, m_reader{data, "JPEG"} {}
+
+    image decode(bool flip_vertically) {
+        size_t pos     = 2;
+        bool has_scan = false;
+
+        while (true) {
+            const u8 marker = next_marker(pos);
+
+            // End of image, or a file cut short after its last scan.
+            if (marker == 0xd9 || pos >= m_data.size()) {
+                break;
+            }
+
+            // Markers without a segment.
+            if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+                continue;
+            }
+
+            const u16 length                  = m_reader.u16_be(pos);
+            const std::span<const u8> segment = m_reader.bytes(pos + 2, std::max<u16>(length, 2) - 2);
+
+            pos += length;
+
+            if (marker == 0xdb) {
+                read_quant_tables(segment);
+            } else if (marker == 0xc4) {
+                read_huffman_tables(segment);
+            } else if (marker == 0xc0 || marker == 0xc1) {
+                read_frame(segment);
+            } else if (is_frame_marker(marker)) {
+                decode_error("JPEG", "only baseline JPEGs are supported");
+            } else if (marker == 0xda) {
+                pos      = decode_scan(segment, pos);
+                has_scan = true;
+            } else if (marker == 0xdd) {
+                m_restart_interval = m_reader.u16_be(pos - length + 2);
+            } else if (marker == 0xee && segment.size() >= 12 &&
+                       std::memcmp(segment.data(), "Adobe", 5) == 0) {
+                m_adobe_transform = segment[11];
+            }
+        }
+
+        if (!has_scan) {
+            decode_error("JPEG", "missing image data");
+        }
+
+        return output(flip_vertically);
+    }
+
+private:
+    std::span<const u8> m_data;
+    byte_reader m_reader;
+
+    std::array<std::array<f32, 64>, 4> m_quant_tables{};
+    std::array<bool, 4> m_has_quant_table{};
+    std::array<jpeg_huffman, 4> m_dc_tables;
+    std::array<jpeg_huffman, 4> m_ac_tables;
+
+    std::vector<jpeg_component> m_components;
+    size_t m_width  = 0;
+    size_t m_height = 0;
+    u32 m_max_h     = 1;
+    u32 m_max_v     = 1;
+
+    u32 m_restart_interval = 0;
+    i32 m_adobe_transform  = -1;
+
+    // Returns the marker at or after pos, and moves pos past it. Fill bytes and data that isn't a marker are
+    // skipped.
+    u8 next_marker(size_t &pos) const {
+        while (pos + 1 < m_data.size()) {
+            if (m_data[pos] == 0xff && m_data[pos + 1] != 0 && m_data[pos + 1] != 0xff) {
+                pos += 2;
+                return m_data[pos - 1];
+            }
+
+            ++pos;
+        }
+
+        pos = m_data.size();
+        return 0;
+    }
+
+    void read_quant_tables(std::span<const u8> segment) {
+        for (size_t pos = 0; pos < segment.size();) {
+            const u32 precision = segment[pos] >> 4;
+            const u32 index     = segment[pos] & 15;
+            const size_t size   = precision == 0 ? 64 : 128;
+
+            if (index >= 4 || precision > 1 || segment.size() - pos - 1 < size) {
+                decode_error("JPEG", "invalid quantization table");
+            }
+
+            for (size_t i = 0; i < 64; ++i) {
+                const u8 *value = &segment[pos + 1 + i * (precision + 1)];
+                const u32 quant = precision == 0 ? value[0] : static_cast<u32>(value[0] << 8 | value[1]);
+                const size_t n  = jpeg_zigzag[i];
+
+                // The IDCT's scale factors, and the 1 / 8 of the 2D IDCT.
+                m_quant_tables[index][n] =
+                    static_cast<f32>(quant) * aan_scales[n / 8] * aan_scales[n % 8] * 0.125f;
+            }
+
+            m_has_quant_table[index] = true;
+            pos += 1 + size;
+        }
+    }
+
+    void read_huffman_tables(std::span<const u8> segment) {
+        for (size_t pos = 0; pos < segment.size();) {
+            const u32 type  = segment[pos] >> 4;
+            const u32 index = segment[pos] & 15;
+
+            if (type > 1 || index >= 4 || segment.size() - pos < 17) {
+                decode_error("JPEG", "invalid Huffman table");
+            }
+
+            const std::span<const u8, 16> counts{segment.data() + pos + 1, 16};
+            size_t symbol_count = 0;
+
+            for (const u8 count : counts) {
+                symbol_count += count;
+            }
+
+            if (symbol_count > 256 || segment.size() - pos - 17 < symbol_count) {
+                decode_error("JPEG", "invalid Huffman table");
+            }
+
+            auto &tables = type == 0 ? m_dc_tables : m_ac_tables;
+            tables[index].build(counts, segment.subspan(pos + 17, symbol_count));
+            pos += 17 + symbol_count;
+        }
+    }
+
+    void read_frame(std::span<const u8> segment) {
+        if (!m_components.empty()) {
+            decode_error("JPEG", "multiple frames");
+        }
+        if (segment.size() < 6 || segment[0] != 8) {
+            decode_error("JPEG", "only 8-bit samples are supported");
+        }
+
+        m_height                = static_cast<size_t>(segment[1] << 8 | segment[2]);
+        m_width                 = static_cast<size_t>(segment[3] << 8 | segment[4]);
+        const u32 component_count = segment[5];
+
+        check_image_size(m_width, m_height, "JPEG");
+
+        if ((component_count != 1 && component_count != 3) || segment.size() < 6 + component_count * 3) {
+            decode_error("JPEG", "only grayscale and color JPEGs are supported");
+        }
+
+        for (u32 i = 0; i < component_count; ++i) {
+            const u8 *spec = &segment[6 + i * 3];
+
+            jpeg_component component{.id           = spec[0],
+                                     .h            = static_cast<u32>(spec[1] >> 4),
+                                     .v            = spec[1] & 15u,
+                                     .quant_table  = spec[2],
+                                     .dc_table     = 0,
+                                     .ac_table     = 0,
+                                     .dc_predictor = 0,
+                                     .width        = 0,
+                                     .height       = 0,
+                                     .blocks_x     = 0,
+                                     .blocks_y     = 0,
+                                     .plane        = {}};
+
+            if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 ||
+                component.quant_table >= 4) {
+                decode_error("JPEG", "invalid frame");
+            }
+
+            m_max_h = std::max(m_max_h, component.h);
+            m_max_v = std::max(m_max_v, component.v);
+            m_components.push_back(std::move(component));
+        }
+
+        const size_t mcus_x = (m_width + m_max_h * 8 - 1) / (m_max_h * 8);
+        const size_t mcus_y = (m_height + m_max_v * 8 - 1) / (m_max_v * 8);
+
+        for (auto &component : m_components) {
+            if (m_max_h % component.h != 0 || m_max_v % component.v != 0) {
+                decode_error("JPEG", "unsupported chroma subsampling");
+            }
+
+            component.width    = (m_width * component.h + m_max_h - 1) / m_max_h;
+            component.height   = (m_height * component.v + m_max_v - 1) / m_max_v;
+            component.blocks_x = mcus_x * component.h;
+            component.blocks_y = mcus_y * component.v;
+            component.plane.resize(component.blocks_x * component.blocks_y * 64);
+        }
+    }
+
+    void decode_block(jpeg_bits &bits, jpeg_component &component, size_t block_x, size_t block_y) {
+        std::array<i32, 64> coefficients{};
+
+        const u32 dc_size = m_dc_tables[component.dc_table].decode(bits);
+
+        if (dc_size > 11) {
+            decode_error("JPEG", "invalid DC coefficient");
+        }
+
+        component.dc_predictor += bits.receive_extend(dc_size);
+        coefficients[0] = component.dc_predictor;
+
+        const jpeg_huffman &ac_table = m_ac_tables[component.ac_table];
+
+        for (u32 k = 1; k < 64;) {
+            const u32 symbol = ac_table.decode(bits);
+            const u32 zeros  = symbol >> 4;
+            const u32 size   = symbol & 15;
+
+            // Either 16 zeros or the end of the block.
+            if (size == 0) {
+                if (zeros != 15) {
+                    break;
+                }
+
+                k += 16;
+                continue;
+            }
+
+            k += zeros;
+
+            if (k > 63) {
+                decode_error("JPEG", "invalid AC coefficient");
+            }
+
+            coefficients[jpeg_zigzag[k++]] = bits.receive_extend(size);
+        }
+
+        const size_t stride = component.blocks_x * 8;
+        idct_block(coefficients, m_quant_tables[component.quant_table],
+                   component.plane.data() + block_y * 8 * stride + block_x * 8, stride);
+    }
+
+    // Decodes the entropy coded data after a scan header at pos, returns where it ended.
+    size_t decode_scan(std::span<const u8> segment, size_t pos) {
+        if (m_components.empty()) {
+            decode_error("JPEG", "scan before frame");
+        }
+
+        const u32 count = segment.empty() ? 0 : segment[0];
+
+        if (count < 1 || count > m_components.size() || segment.size() < 4 + count * 2) {
+            decode_error("JPEG", "invalid scan");
+        }
+
+        // Spectral selection and successive approximation are only for progressive JPEGs.
+        const u8 *selection = &segment[1 + count * 2];
+
+        if (selection[0] != 0 || selection[1] != 63 || selection[2] != 0) {
+            decode_error("JPEG", "invalid scan");
+        }
+
+        std::vector<jpeg_component *> components;
+
+        for (u32 i = 0; i < count; ++i) {
+            const u8 id     = segment[1 + i * 2];
+            const u8 tables = segment[2 + i * 2];
+
+            const auto pos = std::find_if(m_components.begin(), m_components.end(),
+                                          [&](const auto &component) { return component.id == id; });
+
+            if (pos == m_components.end() || (tables >> 4) >= 4 || (tables & 15) >= 4 ||
+                !m_dc_tables[tables >> 4].is_defined() || !m_ac_tables[tables & 15].is_defined() ||
+                !m_has_quant_table[pos->quant_table]) {
+                decode_error("JPEG", "invalid scan");
+            }
+
+            pos->dc_table     = tables >> 4;
+            pos->ac_table     = tables & 15;
+            pos->dc_predictor = 0;
+            components.push_back(&*pos);
+        }
+
+        jpeg_bits bits{m_data, pos};
+        size_t mcu = 0;
+
+        auto next_mcu = [&] {
+            if (m_restart_interval != 0 && mcu != 0 && mcu % m_restart_interval == 0) {
+                bits.restart();
+
+                for (auto *component : components) {
+                    component->dc_predictor = 0;
+                }
+            }
+
+            ++mcu;
+        };
+
+        // A scan of a single component goes over its blocks one at a time, otherwise an MCU holds h * v
+        // blocks of every component.
+        if (count == 1) {
+            jpeg_component &component = *components[0];
+
+            for (size_t y = 0; y < (component.height + 7) / 8; ++y) {
+                for (size_t x = 0; x < (component.width + 7) / 8; ++x) {
+                    next_mcu();
+                    decode_block(bits, component, x, y);
+                }
+            }
+        } else {
+            for (size_t mcu_y = 0; mcu_y < m_components[0].blocks_y / m_components[0].v; ++mcu_y) {
+                for (size_t mcu_x = 0; mcu_x < m_components[0].blocks_x / m_components[0].h; ++mcu_x) {
+                    next_mcu();
+
+                    for (auto *component : components) {
+                        for (size_t y = 0; y < component->v; ++y) {
+                            for (size_t x = 0; x < component->h; ++x) {
+                                decode_block(bits, *component, mcu_x * component->h + x,
+                                             mcu_y * component->v + y);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        return bits.position();
+    }
+
+    /*
+     * Upsamples a row of a component subsampled by 2 horizontally, vertically or both with the triangle
+     * filter of libjpeg's fancy upsampling. Each output sample is 3/4 of the nearest input sample and 1/4 of
+     * the next nearest one, in each direction that is subsampled, with libjpeg's rounding so the results are
+     * the same. far_row is the row above or below near_row, and isn't read if only x is subsampled.
+     */
+    static void upsample_fancy(u8 *dst, size_t width, const u8 *near_row, const u8 *far_row,
+                               size_t sample_count, bool is_x_subsampled, bool is_y_subsampled, bool is_lower) {
+        // Column sums are 4 times the vertically filtered samples.
+        const auto column_sum = [&](size_t x) -> u32 {
+            return is_y_subsampled ? near_row[x] * 3u + far_row[x] : near_row[x] * 4u;
+        };
+
+        if (!is_x_subsampled) {
+            for (size_t x = 0; x < width; ++x) {
+                dst[x] = static_cast<u8>((column_sum(x) + (is_lower ? 2 : 1)) >> 2);
+            }
+            return;
+        }
+
+        // Rounding of the left and right output sample of each input sample.
+        const u32 left_bias  = is_y_subsampled ? 8 : 4;
+        const u32 right_bias = is_y_subsampled ? 7 : 8;
+
+        for (size_t x = 0; x < width; ++x) {
+            const size_t sample_x = x / 2;
+            const u32 sum         = column_sum(sample_x);
+
+            if (x % 2 == 0) {
+                const u32 left_sum = sample_x > 0 ? column_sum(sample_x - 1) : sum;
+                dst[x]             = static_cast<u8>((sum * 3 + left_sum + left_bias) >> 4);
+            } else {
+                const u32 right_sum = sample_x + 1 < sample_count ? column_sum(sample_x + 1) : sum;
+                dst[x]              = static_cast<u8>((sum * 3 + right_sum + right_bias) >> 4);
+            }
+        }
+    }
+
+    image output(bool flip_vertically) const {
+        image result{m_width, m_height, 4};
+
+        // Components with 3 channels are YCbCr, unless an Adobe segment or the component IDs say RGB.
+        const bool has_rgb_ids = m_components.size() == 3 && m_components[0].id == 'R' &&
+                                 m_components[1].id == 'G' && m_components[2].id == 'B';
+        const bool is_rgb      = m_components.size() == 3 &&
+                                 (m_adobe_transform == 0 || (m_adobe_transform == -1 && has_rgb_ids));
+
+        std::array<std::vector<u8>, 3> upsampled;
+        std::array<const u8 *, 3> rows{};
+
+        for (size_t y = 0; y < m_height; ++y) {
+            for (size_t c = 0; c < m_components.size(); ++c) {
+                const jpeg_component &component = m_components[c];
+                const size_t scale_x            = m_max_h / component.h;
+                const size_t scale_y            = m_max_v / component.v;
+                const size_t stride             = component.blocks_x * 8;
+                const size_t sample_y           = y / scale_y;
+                const u8 *row                   = component.plane.data() + sample_y * stride;
+
+                // Components subsampled by 2 are upsampled like libjpeg's fancy upsampling, which is on by
+                // default, and others by repeating samples like libjpeg does too.
+                const bool is_fancy_x = scale_x == 2 && component.width > 2;
+                const bool is_fancy_y = scale_y == 2;
+
+                if (scale_x == 1 && scale_y == 1) {
+                    rows[c] = row;
+                    continue;
+                }
+
+                upsampled[c].resize(m_width);
+                rows[c] = upsampled[c].data();
+
+                if ((is_fancy_x || scale_x == 1) && (is_fancy_y || scale_y == 1)) {
+                    // The row above for the upper output row of a sample and the one below for the lower one.
+                    const bool is_lower = is_fancy_y && y % 2 == 1;
+                    const size_t far_y  = !is_fancy_y ? sample_y
+                                          : is_lower  ? std::min(sample_y + 1, component.height - 1)
+                                                      : sample_y - (sample_y > 0 ? 1 : 0);
+
+                    upsample_fancy(upsampled[c].data(), m_width, row, component.plane.data() + far_y * stride,
+                                   component.width, is_fancy_x, is_fancy_y, is_lower);
+                } else {
+                    for (size_t x = 0; x < m_width; ++x) {
+                        upsampled[c][x] = row[x / scale_x];
+                    }
+                }
+            }
+
+            u8 *dst = image_row(result, y, flip_vertically);
+
+            if (m_components.size() == 1) {
+                for (size_t x = 0; x < m_width; ++x) {
+                    dst[x * 4 + 0] = dst[x * 4 + 1] = dst[x * 4 + 2] = rows[0][x];
+                    dst[x * 4 + 3] = 255;
+                }
+            } else if (is_rgb) {
+                for (size_t x = 0; x < m_width; ++x) {
+                    dst[x * 4 + 0] = rows[0][x];
+                    dst[x * 4 + 1] = rows[1][x];
+                    dst[x * 4 + 2] = rows[2][x];
+                    dst[x * 4 + 3] = 255;
+                }
+            } else {
+                convert_ycbcr_to_rgba(dst, rows[0], rows[1], rows[2], m_width);
+            }
+        }
+
+        return result;
+    }
+};
+
+/*
+ * BMP and ICO
+ */
+
+enum : u32 {
+    bmp_rgb              = 0,
+    bmp_bitfields        = 3,
+    bmp_alpha_bitfields  = 6,
+};
+
+// A channel of a 16 or 32-bit pixel, scaled to 8 bits.
+struct bmp_channel {
+    u32 mask  = 0;
+    u32 shift = 0;
+    u64 max   = 1;
+
+    bmp_channel(u32 mask) : mask{mask} {
+        if (mask != 0) {
+            shift = static_cast<u32>(std::countr_zero(mask));
+            max   = (u64{1} << std::popcount(mask)) - 1;
+        }
+    }
+
+    u8 extract(u32 pixel, u8 fallback) const {
+        return mask == 0 ? fallback : static_cast<u8>(((pixel & mask) >> shift) * 255 / max);
+    }
+};
+
+// The DIB of a BMP file, or of an ICO image with is_icon. pixels_offset is 0 if the pixels follow the
+// palette.
+static image decode_dib(std::span<const u8> data, size_t header, size_t pixels_offset, bool is_icon,
+                        bool flip_vertically) {
+    const std::string_view format = is_icon ? "ICO" : "BMP";
+    const byte_reader reader{data, format};
+
+    const u32 header_size = reader.u32_le(header);
+    i64 width             = static_cast<i32>(reader.u32_le(header + 4));
+    i64 height            = static_cast<i32>(reader.u32_le(header + 8));
+    const u32 bit_count   = reader.u16_le(header + 14);
+    const u32 compression = reader.u32_le(header + 16);
+    const u32 colors_used = reader.u32_le(header + 32);
+
+    if (header_size < 40 ||
+        (compression != bmp_rgb && compression != bmp_bitfields && compression != bmp_alpha_bitfields)) {
+        decode_error(format, "only uncompressed bitmaps are supported");
+    }
+
+    // The height of an icon covers its colors and the transparency mask after them.
+    if (is_icon) {
+        height /= 2;
+    }
+
+    const bool is_top_down = height < 0;
+    height                 = std::abs(height);
+
+    if (width <= 0) {
+        decode_error(format, "invalid image size");
+    }
+
+    check_image_size(static_cast<size_t>(width), static_cast<size_t>(height), format);
+
+    // Bitfield masks are in the header from version 2 on, and follow a version 1 header.
+    std::array<u32, 4> masks{};
+    size_t masks_size = 0;
+
+    if (bit_count == 16) {
+        masks = {0x7c00, 0x03e0, 0x001f, 0};
+    } else if (bit_count == 32) {
+        masks = {0x00ff0000, 0x0000ff00, 0x000000ff, is_icon ? 0xff000000 : 0};
+    } else if (bit_count != 1 && bit_count != 4 && bit_count != 8 && bit_count != 24) {
+        decode_error(format, "invalid bit count");
+    }
+
+    if (compression != bmp_rgb) {
+        if (bit_count != 16 && bit_count != 32) {
+            decode_error(format, "invalid bit count");
+        }
+
+        const size_t mask_count = compression == bmp_alpha_bitfields || header_size >= 56 ? 4 : 3;
+        masks_size              = header_size == 40 ? mask_count * 4 : 0;
+
+        for (size_t i = 0; i < mask_count; ++i) {
+            masks[i] = reader.u32_le(header + 40 + i * 4);
+        }
+    }
+
+    std::array<std::array<u8, 4>, 256> palette{};
+    size_t palette_size = 0;
+
+    if (bit_count <= 8) {
+        palette_size = colors_used != 0 ? std::min<size_t>(colors_used, 256) : size_t{1} << bit_count;
+
+        // BGRX to RGBA.
+        for (size_t i = 0; i < palette_size; ++i) {
+            const auto color = reader.bytes(header + header_size + masks_size + i * 4, 4);
+            palette[i]       = {color[2], color[1], color[0], 255};
+        }
+    }
+
+    if (pixels_offset == 0) {
+        pixels_offset = header + header_size + masks_size + palette_size * 4;
+    }
+
+    const size_t w      = static_cast<size_t>(width);
+    const size_t h      = static_cast<size_t>(height);
+    const size_t stride = (w * bit_count + 31) / 32 * 4;
+
+    const std::array<bmp_channel, 4> channels{masks[0], masks[1], masks[2], masks[3]};
+    const bool is_bgra = bit_count == 32 && masks[0] == 0x00ff0000 && masks[1] == 0x0000ff00 &&
+                         masks[2] == 0x000000ff && (masks[3] == 0xff000000 || masks[3] == 0);
+
+    image result{w, h, 4};
+    bool has_alpha = false;
+
+    for (size_t i = 0; i < h; ++i) {
+        const std::span<const u8> src = reader.bytes(pixels_offset + i * stride, stride);
+        const size_t y                = is_top_down ? i : h - 1 - i;
+        u8 *dst                       = image_row(result, y, flip_vertically);
+        const std::span<u8> dst_row{dst, w * 4};
+
+        if (bit_count == 24) {
+            convert_rgb_to_rgba(dst_row, src.first(w * 3));
+            convert_rgba_to_bgra(dst_row, dst_row);
+        } else if (is_bgra) {
+            convert_rgba_to_bgra(dst_row, src.first(w * 4));
+
+            for (size_t x = 0; x < w; ++x) {
+                if (masks[3] == 0) {
+                    dst[x * 4 + 3] = 255;
+                }
+
+                has_alpha |= dst[x * 4 + 3] != 0;
+            }
+        } else if (bit_count >= 16) {
+            for (size_t x = 0; x < w; ++x) {
+                u32 pixel = 0;
+                std::memcpy(&pixel, src.data() + x * (bit_count / 8), bit_count / 8);
+
+                for (size_t c = 0; c < 4; ++c) {
+                    dst[x * 4 + c] = channels[c].extract(pixel, 255);
+                }
+
+                has_alpha |= dst[x * 4 + 3] != 0;
+            }
+        } else {
+            const u32 index_mask = (1u << bit_count) - 1;
+
+            for (size_t x = 0; x < w; ++x) {
+                const size_t bit = x * bit_count;
+                const u32 index  = (src[bit / 8] >> (8 - bit_count - bit % 8)) & index_mask;
+
+                std::memcpy(dst + x * 4, palette[index].data(), 4);
+            }
+        }
+    }
+
+    // Icons without an alpha channel, or with one that is all zeros, are made transparent by the AND mask.
+    const size_t mask_stride = (w + 31) / 32 * 4;
+    const size_t mask_offset = pixels_offset + h * stride;
+
+    if (is_icon && !(bit_count == 32 && has_alpha) && mask_offset + h * mask_stride <= data.size()) {
+        for (size_t i = 0; i < h; ++i) {
+            const u8 *mask = data.data() + mask_offset + i * mask_stride;
+            u8 *dst        = image_row(result, is_top_down ? i : h - 1 - i, flip_vertically);
+
+            for (size_t x = 0; x < w; ++x) {
+                dst[x * 4 + 3] = (mask[x / 8] >> (7 - x % 8) & 1) != 0 ? 0 : 255;
+            }
+        }
+    }
+
+    return result;
+}
+
+static image decode_ico(std::span<const u8> data, bool flip_vertically) {
+    const byte_reader reader{data, "ICO"};
+    const u32 count = reader.u16_le(4);
+
+    // The largest image, with the most colors.
+    size_t best = 0;
+    std::pair<u32, u32> best_size{0, 0};
+
+    for (u32 i = 0; i < count; ++i) {
+        const size_t entry = 6 + i * 16;
+
+        const u32 width  = reader.u8_at(entry) == 0 ? 256 : reader.u8_at(entry);
+        const u32 height = reader.u8_at(entry + 1) == 0 ? 256 : reader.u8_at(entry + 1);
+
+        const std::pair<u32, u32> size{width * height, reader.u16_le(entry + 6)};
+
+        if (size > best_size) {
+            best      = entry;
+            best_size = size;
+        }
+    }
+
+    if (count == 0) {
+        decode_error("ICO", "no images");
+    }
+
+    const std::span<const u8> image_data = reader.bytes(reader.u32_le(best + 12), reader.u32_le(best + 8));
+
+    if (image_data.size() >= png_signature.size() &&
+        std::equal(png_signature.begin(), png_signature.end(), image_data.begin())) {
+        return decode_png(image_data, flip_vertically);
+    }
+
+    return decode_dib(image_data, 0, 0, true, flip_vertically);
+}
+
+image_file_format vlk::detect_image_format(std::span<const u8> data) {
+    const byte_reader reader{data, "image"};
+
+    auto has_prefix = [&](std::span<const u8> prefix) {
+        return data.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), data.begin());
+    };
+
+    if (has_prefix(png_signature)) {
+        return image_file_format::png;
+    }
+
+    try {
+        // JPEGs are baseline if their frame header is.
+        if (has_prefix(std::array<u8, 2>{0xff, 0xd8})) {
+            for (size_t pos = 2; pos + 4 <= data.size();) {
+                if (data[pos] != 0xff || data[pos + 1] == 0xff) {
+                    ++pos;
+                    continue;
+                }
+
+                const u8 marker = data[pos + 1];
+
+                if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8)) {
+                    pos += 2;
+                    continue;
+                }
+
+                if (is_frame_marker(marker)) {
+                    const bool is_baseline      = marker == 0xc0 || marker == 0xc1;
+                    const u8 precision          = reader.u8_at(pos + 4);
+                    const u8 component_count = reader.u8_at(pos + 9);
+
+                    return is_baseline && precision == 8 && (component_count == 1 || component_count == 3)
+                               ? image_file_format::jpeg
+                               : image_file_format::unknown;
+                }
+
+                if (marker == 0xda || marker == 0xd9) {
+                    return image_file_format::unknown;
+                }
+
+                pos += 2 + size_t{reader.u16_be(pos + 2)};
+            }
+        }
+
+        if (has_prefix(std::array<u8, 2>{'B', 'M'})) {
+            const u32 compression = reader.u32_le(14 + 16);
+
+            return reader.u32_le(14) >= 40 && (compression == bmp_rgb || compression == bmp_bitfields ||
+                                               compression == bmp_alpha_bitfields)
+                       ? image_file_format::bmp
+                       : image_file_format::unknown;
+        }
+
+        // Icons, not cursors.
+        if (reader.u16_le(0) == 0 && reader.u16_le(2) == 1 && reader.u16_le(4) != 0) {
+            return image_file_format::ico;
+        }
+    } catch (const std::runtime_error &) {
+        // Headers cut short.
+    }
+
+    return image_file_format::unknown;
+}
+
+image vlk::decode_image(std::span<const u8> data, bool flip_vertically) {
+    switch (detect_image_format(data)) {
+        case image_file_format::png:
+            return decode_png(data, flip_vertically);
+
+        case image_file_format::jpeg:
+            return jpeg_decoder{data}.decode(flip_vertically);
+
+        case image_file_format::bmp:
+            return decode_dib(data, 14, byte_reader{data, "BMP"}.u32_le(10), false, flip_vertically);
+
+        case image_file_format::ico:
+            return decode_ico(data, flip_vertically);
+
+        default:
+            throw std::runtime_error("Valkyrie: unsupported image format.");
+    }
+}
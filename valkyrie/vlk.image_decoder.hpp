@@ -0,0 +1,34 @@
+#pragma once
+
+#include <span>
+
+#include "vlk.types.hpp"
+#include "vlk.gfx.hpp"
+
+/*
+ * Image file decoding, without system libraries.
+ *
+ * Supported are PNG (every color type and bit depth, interlaced or not), baseline JPEG (grayscale, YCbCr or
+ * RGB, with any whole number chroma subsampling), uncompressed BMP, and ICO with BMP or PNG images. Images
+ * are decoded to 8-bit RGBA and written to the image a row at a time, flipped if asked, so there is no
+ * separate pass to flip them.
+ *
+ * NOTE: The JPEG IDCT and color conversion use the SIMD instruction sets in vlk.types.hpp, with a scalar
+ *       fallback. They all give the same results.
+ */
+namespace vlk {
+    enum class image_file_format {
+        unknown,
+        png,
+        jpeg,
+        bmp,
+        ico,
+    };
+
+    // The format of an image file from its headers. Files that decode_image() doesn't support, e.g.
+    // progressive JPEGs or RLE compressed BMPs, are unknown.
+    image_file_format detect_image_format(std::span<const u8> data);
+
+    // Throws std::runtime_error if data isn't a valid image in a supported format.
+    image decode_image(std::span<const u8> data, bool flip_vertically = false);
+}  // namespace vlk
@@ -2,10 +2,14 @@
 
 #include <string_view>
 #include <fstream>
-#include <sstream>
 #include <format>
 #include <stdexcept>
+#include <charconv>
 #include <print>
+#include <algorithm>
+#include <exception>
+#include <utility>
+#include <unordered_map>
 
 #include "vlk.util.hpp"
 #include "vlk.system.hpp"
@@ -13,272 +17,539 @@
 using namespace vlk;
 
 static std::string load_text_file(std::filesystem::path path) {
-    std::ifstream file(path);
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
 
     if (!file.is_open()) {
         throw std::runtime_error(std::format("Valkyrie: file not found error: {}", path.string()));
     }
 
-    std::stringstream buf;
-    buf << file.rdbuf();
-    return buf.str();
+    std::string text(static_cast<size_t>(file.tellg()), '\0');
+
+    file.seekg(0);
+    file.read(text.data(), static_cast<std::streamsize>(text.size()));
+
+    return text;
 }
 
-static std::vector<std::vector<std::string>> tokenize_obj_or_mtl(std::string_view file_content) {
-    std::vector<std::vector<std::string>> tokens;
+/*
+ * Reads the lines of an OBJ or MTL file one at a time, and the whitespace separated tokens of a line as
+ * views into the text, so nothing is allocated per token. Numbers are parsed with std::from_chars.
+ */
+class obj_reader {
+public:
+    // Lines are numbered in errors from first_line_number + 1, for text that starts in the middle of a file.
+    obj_reader(std::string_view text, const std::filesystem::path& path, size_t first_line_number = 0)
+        : m_text{text}, m_line_number{first_line_number}, m_path{path} {}
+
+    // Moves to the next line that has tokens and isn't a comment, and returns its first token. Returns an
+    // empty view at the end of the text.
+    std::string_view next_line() {
+        while (!m_text.empty()) {
+            const size_t line_end = m_text.find('\n');
+
+            m_line = m_text.substr(0, line_end);
+            m_text = line_end == std::string_view::npos ? std::string_view{} : m_text.substr(line_end + 1);
+            ++m_line_number;
+
+            const std::string_view token = next_token();
+
+            if (!token.empty() && token.front() != '#') {
+                return token;
+            }
+        }
 
-    for (auto& line : string_split(file_content, "\n")) {
-        // Remove all tabs.
-        line.erase(std::remove(line.begin(), line.end(), '\t'), line.end());
+        return {};
+    }
 
-        const auto& line_tokens = string_split(line, " ");
+    // The next token of the line, empty at the end of the line.
+    std::string_view next_token() {
+        size_t start = 0;
 
-        if (line_tokens.empty()) {
-            continue;
+        while (start < m_line.size() && is_space(m_line[start])) {
+            ++start;
         }
 
-        if (line_tokens.at(0) == "#") {
-            continue;
+        size_t end = start;
+
+        while (end < m_line.size() && !is_space(m_line[end])) {
+            ++end;
         }
 
-        tokens.emplace_back(line_tokens);
+        const std::string_view token = m_line.substr(start, end - start);
+        m_line.remove_prefix(end);
+
+        return token;
     }
 
-    return tokens;
-}
+    std::string_view expect_token() {
+        const std::string_view token = next_token();
+
+        if (token.empty()) {
+            error("unexpected end of line");
+        }
+
+        return token;
+    }
+
+    f32 expect_f32() { return parse_number<f32>(expect_token()); }
+
+    template <typename T>
+    T parse_number(std::string_view token) const {
+        // Unlike std::stof() and std::stoi(), std::from_chars() doesn't skip a plus sign.
+        if (token.starts_with('+')) {
+            token.remove_prefix(1);
+        }
+
+        T value{};
+        const auto [end, result] = std::from_chars(token.data(), token.data() + token.size(), value);
+
+        if (result != std::errc{} || end != token.data() + token.size()) {
+            error(std::format("invalid number {}", token));
+        }
+
+        return value;
+    }
+
+    // Number of the current line, or of the last one at the end of the text.
+    size_t line_number() const { return m_line_number; }
+
+    [[noreturn]] void error(std::string_view message) const {
+        throw std::runtime_error(std::format("Valkyrie: error when parsing {} on line {}: {}.",
+                                             m_path.string(), m_line_number, message));
+    }
+
+private:
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    std::string_view m_text;
+    std::string_view m_line;
+    size_t m_line_number = 0;
+
+    const std::filesystem::path& m_path;
+};
+
+// Texture map statements of an MTL file and the material indices they set.
+static constexpr std::array<std::pair<std::string_view, size_t model::material::*>, 10> texture_maps{
+    {{"map_Ka", &model::material::albedo},
+     {"map_Kd", &model::material::albedo},
+     {"norm", &model::material::normal},
+     {"bump", &model::material::normal},
+     {"map_bump", &model::material::normal},
+     {"Pr", &model::material::roughness},
+     {"map_Pr", &model::material::roughness},
+     {"Pm", &model::material::metallic},
+     {"map_Pm", &model::material::metallic},
+     {"map_d", &model::material::opacity}}
+};
+
+// The paths of the images of a model in the order they are first used, each path once.
+struct image_path_set {
+    struct path_hash {
+        size_t operator()(const std::filesystem::path& path) const {
+            return std::filesystem::hash_value(path);
+        }
+    };
+
+    std::vector<std::filesystem::path> paths;
+    std::unordered_map<std::filesystem::path, size_t, path_hash> indices;
+
+    size_t insert(const std::filesystem::path& path) {
+        const auto [pos, is_new] = indices.try_emplace(path, paths.size());
+
+        if (is_new) {
+            paths.push_back(path);
+        }
+
+        return pos->second;
+    }
+};
 
+// Images are only gathered here, load_obj() decodes them all at once.
 static void parse_mtl(std::filesystem::path path,
                       std::vector<std::pair<std::string, model::material>>& materials,
-                      std::vector<std::pair<std::filesystem::path, image>>& images,
-                      bool flip_images_vertically) {
-    const auto tokens = tokenize_obj_or_mtl(load_text_file(path));
+                      image_path_set& images) {
+    const std::string text = load_text_file(path);
+
+    obj_reader reader{text, path};
 
     /*
      * An MTL can contain multiple materials.
      * Each new material starts with: newmtl <material name>
      */
 
-    auto current_newmtl_pos = std::find_if(
-        tokens.begin(), tokens.end(), [](const auto& line_tokens) { return line_tokens.at(0) == "newmtl"; });
+    model::material* material = nullptr;
 
-    while (current_newmtl_pos != tokens.end()) {
-        auto next_newmtl_pos =
-            std::find_if(current_newmtl_pos + 1, tokens.end(),
-                         [](const auto& line_tokens) { return line_tokens.at(0) == "newmtl"; });
+    for (std::string_view keyword = reader.next_line(); !keyword.empty(); keyword = reader.next_line()) {
+        if (keyword == "newmtl") {
+            const std::string_view material_name = reader.expect_token();
 
-        const std::string& material_name = current_newmtl_pos->at(1);
+            auto is_defined         = [&](const auto& elem) { return elem.first == material_name; };
+            const auto material_pos = std::find_if(materials.begin(), materials.end(), is_defined);
 
-        const auto material_pos = std::find_if(materials.begin(), materials.end(),
-                                               [&](const auto& elem) { return elem.first == material_name; });
+            if (material_pos != materials.end()) {
+                throw std::runtime_error(
+                    std::format("Valkyrie: error when parsing mtl {}: material {} is already defined.",
+                                path.string(), material_name));
+            }
 
-        if (material_pos != materials.end()) {
-            throw std::runtime_error(
-                std::format("Valkyrie: error when parsing mtl {}: material {} is already defined.",
-                            path.string(), material_name));
+            materials.emplace_back(material_name, model::material{.name = std::string{material_name}});
+            material = &materials.back().second;
+            continue;
         }
 
-        model::material material{.name{material_name}};
+        const auto map_pos = std::find_if(texture_maps.begin(), texture_maps.end(),
+                                          [&](const auto& map) { return map.first == keyword; });
 
-        const std::unordered_map<std::string, size_t&> indices{
-            {"map_Ka",   material.albedo   },
-            {"map_Kd",   material.albedo   },
+        if (material == nullptr || map_pos == texture_maps.end()) {
+            continue;
+        }
 
-            {"norm",     material.normal   },
-            {"bump",     material.normal   },
-            {"map_bump", material.normal   },
+        material->*map_pos->second = images.insert(path.parent_path() / reader.expect_token());
+    }
+}
 
-            {"Pr",       material.roughness},
-            {"map_Pr",   material.roughness},
+/*
+ * Index into an array from a 1-based OBJ index. Negative ones count back from the count elements parsed so
+ * far, positive ones may refer to elements further on in the file and must be at most its total.
+ */
+static size_t resolve_index(const obj_reader& reader, std::string_view token, size_t count, size_t total) {
+    const i64 index = reader.parse_number<i64>(token);
 
-            {"Pm",       material.metallic },
-            {"map_Pm",   material.metallic },
+    if (index == 0 || (index < 0 && static_cast<size_t>(-index) > count) ||
+        (index > 0 && static_cast<size_t>(index) > total)) {
+        reader.error(std::format("invalid index {}", token));
+    }
 
-            {"map_d",    material.opacity  }
-        };
+    return index > 0 ? static_cast<size_t>(index - 1) : count - static_cast<size_t>(-index);
+}
 
-        std::for_each(current_newmtl_pos, next_newmtl_pos, [&](const auto& line_tokens) {
-            const std::string token = line_tokens.at(0);
+/*
+ * A run of whole lines of an OBJ file. Chunks are counted and then parsed in parallel. Every chunk writes its
+ * vertices straight into the model after those of the chunks before it, so indices resolve the same as in a
+ * serial parse. The faces before the first "usemtl" of a chunk go in meshes[0], which continues the mesh
+ * the chunk before it ended in.
+ */
+struct obj_chunk {
+    std::string_view text;
+
+    // Counted in the first pass, then turned into the offsets of the chunk's first line and vertices.
+    size_t lines      = 0;
+    size_t positions  = 0;
+    size_t tex_coords = 0;
+    size_t normals    = 0;
+
+    std::vector<model::mesh> meshes;
+    std::vector<std::string_view> mesh_material_names;  // Of meshes[1] onwards.
+    std::vector<std::string_view> material_libraries;   // Found while counting.
+
+    std::exception_ptr error;  // thread_pool::parallel_for() doesn't pass exceptions on.
+};
+
+// Splits text after newlines into at most count chunks of about the same size.
+static std::vector<obj_chunk> split_obj(std::string_view text, size_t count) {
+    std::vector<obj_chunk> chunks;
+
+    for (size_t i = 1, start = 0; i <= count && start < text.size(); ++i) {
+        size_t end = text.size();
+
+        if (i < count) {
+            end = text.find('\n', std::max(start, text.size() / count * i));
+            end = end == std::string_view::npos ? text.size() : end + 1;
+        }
 
-            auto index_pos = indices.find(token);
+        chunks.push_back({.text = text.substr(start, end - start)});
+        start = end;
+    }
 
-            if (index_pos != indices.end()) {
-                const auto image_path = path.remove_filename() / line_tokens.at(1);
+    return chunks;
+}
 
-                const auto image_pos = std::find_if(
-                    images.begin(), images.end(), [&](const auto& elem) { return elem.first == image_path; });
+static void count_obj_chunk(obj_chunk& chunk, const std::filesystem::path& path) {
+    obj_reader reader{chunk.text, path};
+
+    for (std::string_view keyword = reader.next_line(); !keyword.empty(); keyword = reader.next_line()) {
+        if (keyword == "v") {
+            ++chunk.positions;
+        } else if (keyword == "vt") {
+            ++chunk.tex_coords;
+        } else if (keyword == "vn") {
+            ++chunk.normals;
+        } else if (keyword == "mtllib") {
+            // A missing path is reported by parse_obj_chunk(), which reports errors in file order.
+            if (const std::string_view library = reader.next_token(); !library.empty()) {
+                chunk.material_libraries.push_back(library);
+            }
+        }
+    }
 
-                const size_t index = [&]() -> size_t {
-                    // Check if an image with this path has already been loaded.
-                    if (image_pos != images.end()) {
-                        return image_pos - images.begin();
+    chunk.lines = reader.line_number();
+}
 
-                    } else {
-                        images.push_back(
-                            std::make_pair(image_path, load_image(image_path, flip_images_vertically)));
-                        return images.size() - 1;
-                    }
-                }();
+static void parse_obj_chunk(obj_chunk& chunk, model& model, const std::filesystem::path& path) {
+    obj_reader reader{chunk.text, path, chunk.lines};
 
-                size_t& image = index_pos->second;
-                image         = index;
-            }
-        });
+    // Vertices parsed so far in the whole file, which is what negative indices count back from. The model's
+    // arrays are already sized to the totals of the file, which positive indices are checked against.
+    size_t positions  = chunk.positions;
+    size_t tex_coords = chunk.tex_coords;
+    size_t normals    = chunk.normals;
 
-        materials.push_back(std::make_pair(material.name, material));
+    chunk.meshes.push_back({.material_index{model::null_index}, .has_tex_coords{false}, .has_normals{false}});
+    model::mesh* mesh = &chunk.meshes.back();
 
-        current_newmtl_pos = next_newmtl_pos;
-    }
-}
+    // Corners of the current face, reused from face to face.
+    std::vector<std::array<size_t, 3>> corners;
 
-model vlk::load_obj(std::filesystem::path path, bool flip_images_vertically) {
-    model model;
+    for (std::string_view keyword = reader.next_line(); !keyword.empty(); keyword = reader.next_line()) {
+        if (keyword == "v") {
+            const f32 x = reader.expect_f32();
+            const f32 y = reader.expect_f32();
+            const f32 z = reader.expect_f32();
+            model.positions[positions++] = {x, y, z};
+        }
 
-    const auto tokens = tokenize_obj_or_mtl(load_text_file(path));
+        else if (keyword == "vt") {
+            const f32 u = reader.expect_f32();
+            const f32 v = reader.expect_f32();
+            model.tex_coords[tex_coords++] = {u, v};
+        }
 
-    // Parse MTL files.
+        else if (keyword == "vn") {
+            const f32 x = reader.expect_f32();
+            const f32 y = reader.expect_f32();
+            const f32 z = reader.expect_f32();
+            model.normals[normals++] = {x, y, z};
+        }
 
-    std::vector<std::pair<std::string, model::material>> materials;
-    std::vector<std::pair<std::filesystem::path, image>> images;
+        else if (keyword == "f") {
+            corners.clear();
 
-    auto mtllib_pos = std::find_if(tokens.begin(), tokens.end(),
-                                   [](const auto& line_tokens) { return line_tokens.at(0) == "mtllib"; });
+            // Corners are position, position/tex_coord, position/tex_coord/normal or position//normal.
+            for (std::string_view token = reader.next_token(); !token.empty(); token = reader.next_token()) {
+                std::array<size_t, 3> corner{};
 
-    while (mtllib_pos != tokens.end()) {
-        const auto mtl_path = path.remove_filename() / mtllib_pos->at(1);
+                const size_t tex_coord_start = token.find('/');
+                const std::string_view position = token.substr(0, tex_coord_start);
 
-        parse_mtl(mtl_path, materials, images, flip_images_vertically);
+                corner[0] = resolve_index(reader, position, positions, model.positions.size());
 
-        mtllib_pos = std::find_if(mtllib_pos + 1, tokens.end(),
-                                  [](const auto& line_tokens) { return line_tokens.at(0) == "mtllib"; });
-    }
+                if (tex_coord_start != std::string_view::npos) {
+                    const std::string_view rest      = token.substr(tex_coord_start + 1);
+                    const size_t normal_start        = rest.find('/');
+                    const std::string_view tex_coord = rest.substr(0, normal_start);
 
-    for (const auto& [_, material] : materials) {
-        model.materials.push_back(material);
-    }
-    for (const auto& [_, image] : images) {
-        model.images.push_back(image);
-    }
+                    // Corners without one keep index 0, which is only read if the mesh has other corners
+                    // with tex coords.
+                    if (!tex_coord.empty() || normal_start == std::string_view::npos) {
+                        corner[1] = resolve_index(reader, tex_coord, tex_coords, model.tex_coords.size());
+                        mesh->has_tex_coords = true;
+                    }
+
+                    if (normal_start != std::string_view::npos) {
+                        const std::string_view normal = rest.substr(normal_start + 1);
+
+                        corner[2]         = resolve_index(reader, normal, normals, model.normals.size());
+                        mesh->has_normals = true;
+                    }
+                }
+
+                corners.push_back(corner);
+            }
 
-    // Parse meshes.
+            if (corners.size() < 3) {
+                reader.error("face with less than 3 corners");
+            }
+
+            // Triangles of consecutive corners, wrapping around.
+            for (size_t i = 0; i < corners.size() - 2; ++i) {
+                model::mesh::face face{};
+
+                for (size_t j = 0; j < 3; ++j) {
+                    const auto& corner = corners[(i * 2 + j) % corners.size()];
+
+                    face.positions[j]  = corner[0];
+                    face.tex_coords[j] = corner[1];
+                    face.normals[j]    = corner[2];
+                }
 
-    for (const auto& line_tokens : tokens) {
-        if (line_tokens.at(0) == "v") {
-            model.positions.emplace_back(vec3f(std::stof(line_tokens.at(1)), std::stof(line_tokens.at(2)),
-                                               std::stof(line_tokens.at(3))));
+                mesh->faces.push_back(face);
+            }
         }
 
-        else if (line_tokens.at(0) == "vt") {
-            model.tex_coords.emplace_back(vec2f(std::stof(line_tokens.at(1)), std::stof(line_tokens.at(2))));
+        else if (keyword == "usemtl") {
+            chunk.mesh_material_names.push_back(reader.expect_token());
+
+            chunk.meshes.push_back({.material_index{0}, .has_tex_coords{false}, .has_normals{false}});
+            mesh = &chunk.meshes.back();
         }
 
-        else if (line_tokens.at(0) == "vn") {
-            model.normals.emplace_back(vec3f(std::stof(line_tokens.at(1)), std::stof(line_tokens.at(2)),
-                                             std::stof(line_tokens.at(3))));
+        else if (keyword == "mtllib") {
+            reader.expect_token();
         }
     }
+}
 
-    auto current_usemtl_pos = std::find_if(
-        tokens.begin(), tokens.end(), [](const auto& line_tokens) { return line_tokens.at(0) == "usemtl"; });
+model vlk::load_obj(std::filesystem::path path, bool flip_images_vertically, bool compress_textures,
+                    bool premultiply_alpha, bool use_cache) {
+    // Images are stored flipped or not and textures built with these options, so they are the cache key.
+    std::filesystem::path cache_path = path;
+    cache_path += ".vlkm";
 
-    // Edge case: if there's zero "usemtl"'s found, parse everything as a single mesh without a material.
-    if (current_usemtl_pos == tokens.end()) {
-        model::mesh mesh{.material_index = model::null_index, .has_tex_coords = false, .has_normals = false};
+    const u64 cache_key = static_cast<u64>(flip_images_vertically) |
+                          static_cast<u64>(compress_textures) << 1 | static_cast<u64>(premultiply_alpha) << 2;
 
-        std::for_each(tokens.begin(), tokens.end(), [&](const auto& line_tokens) {
-            if (line_tokens.at(0) == "f") {
-                size_t triangle_count{line_tokens.size() - 3};
+    // A cache that can't be read is parsed again and rewritten.
+    if (use_cache) {
+        try {
+            if (is_vlkm_current(cache_path, cache_key)) {
+                return load_vlkm(cache_path, compress_textures, premultiply_alpha);
+            }
+        } catch (const std::runtime_error&) {
+        }
+    }
 
-                for (size_t i{0}; i < triangle_count; ++i) {
-                    model::mesh::face face{};
+    model model;
 
-                    for (size_t j{0}; j < 3; ++j) {
-                        size_t token_index{1 + ((i * 2 + j) % (line_tokens.size() - 1))};
+    const std::string text = load_text_file(path);
 
-                        const auto indices{string_split(line_tokens.at(token_index), "/", true)};
+    std::vector<std::pair<std::string, model::material>> materials;
+    image_path_set image_set;
 
-                        face.positions.at(j) = std::stoi(indices.at(0)) - 1;
+    std::vector<std::filesystem::path> sources{path};
 
-                        if (indices.size() == 2) {
-                            face.tex_coords.at(j) = std::stoi(indices.at(1)) - 1;
-                            mesh.has_tex_coords   = true;
-                        } else if (indices.size() == 3) {
-                            if (!indices.at(1).empty()) {
-                                face.tex_coords.at(j) = std::stoi(indices.at(1)) - 1;
-                            }
+    // A few chunks per thread so threads that finish early can take another, but not so small that the
+    // stitching below adds up.
+    constexpr size_t min_chunk_size = 1 << 20;
 
-                            face.normals.at(j) = std::stoi(indices.at(2)) - 1;
+    thread_pool& pool = thread_pool::global();
 
-                            mesh.has_tex_coords = true;
-                            mesh.has_normals    = true;
-                        }
-                    }
+    std::vector<obj_chunk> chunks =
+        split_obj(text, std::clamp<size_t>(text.size() / min_chunk_size, 1, pool.thread_count() * 4));
 
-                    mesh.faces.emplace_back(face);
-                }
-            }
-        });
+    pool.parallel_for(chunks.size(), [&](size_t i) { count_obj_chunk(chunks[i], path); });
 
-        model.meshes.emplace_back(mesh);
-        return model;
+    // Counts to offsets.
+    size_t lines = 0, positions = 0, tex_coords = 0, normals = 0;
+
+    for (auto& chunk : chunks) {
+        lines      += std::exchange(chunk.lines, lines);
+        positions  += std::exchange(chunk.positions, positions);
+        tex_coords += std::exchange(chunk.tex_coords, tex_coords);
+        normals    += std::exchange(chunk.normals, normals);
     }
 
-    while (current_usemtl_pos != tokens.end()) {
-        auto next_usemtl_pos =
-            std::find_if(current_usemtl_pos + 1, tokens.end(),
-                         [](const auto& line_tokens) { return line_tokens.at(0) == "usemtl"; });
+    model.positions.resize(positions);
+    model.tex_coords.resize(tex_coords);
+    model.normals.resize(normals);
 
-        const std::string& material_name = current_usemtl_pos->at(1);
+    // MTL files are small, parsing them up front lets their images decode alongside the geometry.
+    for (const auto& chunk : chunks) {
+        for (const std::string_view library : chunk.material_libraries) {
+            sources.push_back(path.parent_path() / library);
+            parse_mtl(sources.back(), materials, image_set);
+        }
+    }
 
-        auto material_pos = std::find_if(materials.begin(), materials.end(),
-                                         [&](const auto& elem) { return elem.first == material_name; });
+    std::vector<image> images(image_set.paths.size());
+    std::vector<std::exception_ptr> image_errors(images.size());
 
-        if (material_pos == materials.end()) {
-            throw std::runtime_error(
-                std::format("Valkyrie: error when parsing mesh {}: material {} does not exist.",
-                            path.string(), material_name));
+    // Images first, a single image can take longer to decode than a chunk takes to parse.
+    pool.parallel_for(images.size() + chunks.size(), [&](size_t i) {
+        if (i < images.size()) {
+            try {
+                images[i] = load_image(image_set.paths[i], flip_images_vertically);
+            } catch (...) {
+                image_errors[i] = std::current_exception();
+            }
+            return;
         }
 
-        const size_t material_index = material_pos - materials.begin();
+        obj_chunk& chunk = chunks[i - images.size()];
 
-        model::mesh mesh{.material_index{material_index}, .has_tex_coords{false}, .has_normals{false}};
+        try {
+            parse_obj_chunk(chunk, model, path);
+        } catch (...) {
+            chunk.error = std::current_exception();
+        }
+    });
 
-        std::for_each(current_usemtl_pos, next_usemtl_pos, [&](const auto& line_tokens) {
-            if (line_tokens.at(0) == "f") {
-                size_t triangle_count{line_tokens.size() - 3};
+    // The first error in the file, as a serial parse would have thrown.
+    for (const auto& chunk : chunks) {
+        if (chunk.error) {
+            std::rethrow_exception(chunk.error);
+        }
+    }
+    for (const auto& error : image_errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
 
-                for (size_t i{0}; i < triangle_count; ++i) {
-                    model::mesh::face face{};
+    /*
+     * Each "usemtl" starts a new mesh, faces before the first one are only kept if there are none. Then
+     * everything is a single mesh without a material. Material names are looked up at the end, so MTL files
+     * may come after the meshes that use them.
+     */
+    model::mesh loose_mesh{.material_index{model::null_index}, .has_tex_coords{false}, .has_normals{false}};
+    model::mesh* mesh = &loose_mesh;
 
-                    for (size_t j{0}; j < 3; ++j) {
-                        size_t token_index{1 + ((i * 2 + j) % (line_tokens.size() - 1))};
+    std::vector<std::string_view> mesh_material_names;
 
-                        const auto indices{string_split(line_tokens.at(token_index), "/", true)};
+    for (auto& chunk : chunks) {
+        model::mesh& continued = chunk.meshes.front();
 
-                        face.positions.at(j) = std::stoi(indices.at(0)) - 1;
+        if (mesh->faces.empty()) {
+            mesh->faces = std::move(continued.faces);
+        } else {
+            mesh->faces.insert(mesh->faces.end(), continued.faces.begin(), continued.faces.end());
+        }
 
-                        if (indices.size() == 2) {
-                            face.tex_coords.at(j) = std::stoi(indices.at(1)) - 1;
-                            mesh.has_tex_coords   = true;
-                        } else if (indices.size() == 3) {
-                            if (!indices.at(1).empty()) {
-                                face.tex_coords.at(j) = std::stoi(indices.at(1)) - 1;
-                            }
+        mesh->has_tex_coords |= continued.has_tex_coords;
+        mesh->has_normals    |= continued.has_normals;
 
-                            face.normals.at(j) = std::stoi(indices.at(2)) - 1;
+        for (size_t i = 1; i < chunk.meshes.size(); ++i) {
+            model.meshes.push_back(std::move(chunk.meshes[i]));
+            mesh_material_names.push_back(chunk.mesh_material_names[i - 1]);
+        }
 
-                            mesh.has_tex_coords = true;
-                            mesh.has_normals    = true;
-                        }
-                    }
+        if (!model.meshes.empty()) {
+            mesh = &model.meshes.back();
+        }
+    }
 
-                    mesh.faces.emplace_back(face);
-                }
-            }
-        });
+    for (size_t i = 0; i < model.meshes.size(); ++i) {
+        const std::string_view material_name = mesh_material_names[i];
 
-        model.meshes.emplace_back(mesh);
+        auto material_pos = std::find_if(materials.begin(), materials.end(),
+                                         [&](const auto& elem) { return elem.first == material_name; });
+
+        if (material_pos == materials.end()) {
+            throw std::runtime_error(
+                std::format("Valkyrie: error when parsing mesh {}: material {} does not exist.",
+                            path.string(), material_name));
+        }
 
-        current_usemtl_pos = next_usemtl_pos;
+        model.meshes[i].material_index = material_pos - materials.begin();
+    }
+
+    if (model.meshes.empty()) {
+        model.meshes.push_back(std::move(loose_mesh));
+    }
+
+    for (const auto& [_, material] : materials) {
+        model.materials.push_back(material);
+    }
+    sources.insert(sources.end(), image_set.paths.begin(), image_set.paths.end());
+    model.images = std::move(images);
+    model.build_textures(compress_textures, premultiply_alpha);
+
+    // The cache is optional, so a model that was parsed is returned even if it can't be written, e.g. to a
+    // read-only directory or a full disk.
+    if (use_cache) {
+        try {
+            save_vlkm(model, cache_path, sources, cache_key);
+        } catch (const std::runtime_error&) {
+        }
     }
 
     return model;
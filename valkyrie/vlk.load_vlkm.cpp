@@ -0,0 +1,506 @@
+#include "vlk.system.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <format>
+#include <stdexcept>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "vlk.util.hpp"
+
+using namespace vlk;
+
+/*
+ * A .vlkm file starts with a vlkm_header, which holds the offset and size in bytes of every section. Each
+ * section starts at a multiple of vlkm_alignment. Names and paths are in the strings section, and pixels,
+ * texels and blocks in the pixels section, aligned to their type. The records that use them hold their
+ * offset and size within it.
+ */
+static constexpr std::array<char, 4> vlkm_magic{'V', 'L', 'K', 'M'};
+static constexpr u32 vlkm_version     = 2;
+static constexpr size_t vlkm_alignment = 64;
+
+enum vlkm_section : size_t {
+    vlkm_sources,     // vlkm_source
+    vlkm_positions,   // vec3f
+    vlkm_tex_coords,  // vec2f
+    vlkm_normals,     // vec3f
+    vlkm_meshes,      // vlkm_mesh
+    vlkm_faces,       // model::mesh::face, of all meshes one after the other.
+    vlkm_materials,   // vlkm_material
+    vlkm_images,      // vlkm_image
+    vlkm_textures,    // vlkm_texture
+    vlkm_levels,      // vlkm_level, of all textures one after the other.
+    vlkm_strings,
+    vlkm_pixels,
+    vlkm_section_count
+};
+
+struct vlkm_range {
+    u64 offset;
+    u64 size;
+};
+
+struct vlkm_header {
+    std::array<char, 4> magic;
+    u32 version;
+    u64 key;
+    std::array<vlkm_range, vlkm_section_count> sections;
+};
+
+struct vlkm_source {
+    vlkm_range path;  // UTF-8.
+    u64 size;
+    i64 write_time;
+};
+
+struct vlkm_mesh {
+    u64 material_index;
+    u64 first_face;
+    u64 face_count;
+    u32 has_tex_coords;
+    u32 has_normals;
+};
+
+struct vlkm_material {
+    vlkm_range name;
+    u64 albedo;
+    u64 normal;
+    u64 roughness;
+    u64 metallic;
+    u64 opacity;
+};
+
+struct vlkm_image {
+    u64 width;
+    u64 height;
+    u64 channels;
+    vlkm_range pixels;
+};
+
+struct vlkm_texture {
+    u32 format;
+    u32 is_premultiplied;
+    u64 first_level;
+    u64 level_count;
+};
+
+struct vlkm_level {
+    u64 width;
+    u64 height;
+    vlkm_range texels;  // color_rgba
+    vlkm_range blocks;  // u64
+};
+
+// Sections are copied to and from memory as they are.
+static_assert(sizeof(size_t) == sizeof(u64), "Faces are stored with 64-bit indices.");
+static_assert(sizeof(vec3f) == 3 * sizeof(f32) && std::is_trivially_copyable_v<vec3f>);
+static_assert(sizeof(vec2f) == 2 * sizeof(f32) && std::is_trivially_copyable_v<vec2f>);
+static_assert(std::is_trivially_copyable_v<model::mesh::face>);
+static_assert(sizeof(color_rgba) == 4 && std::is_trivially_copyable_v<color_rgba>);
+
+static std::runtime_error invalid_vlkm_error(const std::filesystem::path &path) {
+    return std::runtime_error(std::format("Valkyrie: {} is not a valid vlkm file.", path.string()));
+}
+
+static size_t align_up(size_t size) {
+    return (size + vlkm_alignment - 1) / vlkm_alignment * vlkm_alignment;
+}
+
+// Appends the bytes of values to a section, aligned to their type, and returns where they are in it.
+template <typename T>
+static vlkm_range append(std::vector<u8> &section, std::span<const T> values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    section.resize((section.size() + alignof(T) - 1) / alignof(T) * alignof(T));
+
+    const auto *bytes = reinterpret_cast<const u8 *>(values.data());
+    const vlkm_range range{.offset = section.size(), .size = values.size_bytes()};
+
+    section.insert(section.end(), bytes, bytes + values.size_bytes());
+
+    return range;
+}
+
+template <typename T>
+static vlkm_range append_record(std::vector<u8> &section, const T &value) {
+    return append(section, std::span<const T>{&value, 1});
+}
+
+static vlkm_range append(std::vector<u8> &section, std::string_view string) {
+    return append(section, std::span<const char>{string});
+}
+
+// The files a .vlkm file was written from are keyed by their size and write time.
+static std::pair<u64, i64> file_stamp(const std::filesystem::path &path, std::error_code &error) {
+    const u64 size = std::filesystem::file_size(path, error);
+
+    if (error) {
+        return {};
+    }
+
+    return {size, std::filesystem::last_write_time(path, error).time_since_epoch().count()};
+}
+
+void vlk::save_vlkm(const model &model, std::filesystem::path path,
+                    std::span<const std::filesystem::path> sources, u64 key) {
+    std::array<std::vector<u8>, vlkm_section_count> sections;
+
+    for (const auto &source : sources) {
+        std::error_code error;
+        const auto [size, write_time] = file_stamp(source, error);
+
+        if (error) {
+            throw std::runtime_error(std::format("Valkyrie: file not found {}.", source.string()));
+        }
+
+        const std::u8string source_path = source.u8string();
+        const std::string_view utf8{reinterpret_cast<const char *>(source_path.data()), source_path.size()};
+
+        const vlkm_source record{.path       = append(sections[vlkm_strings], utf8),
+                                 .size       = size,
+                                 .write_time = write_time};
+
+        append_record(sections[vlkm_sources], record);
+    }
+
+    append(sections[vlkm_positions], std::span{model.positions});
+    append(sections[vlkm_tex_coords], std::span{model.tex_coords});
+    append(sections[vlkm_normals], std::span{model.normals});
+
+    for (const auto &mesh : model.meshes) {
+        const u64 first_face = sections[vlkm_faces].size() / sizeof(model::mesh::face);
+
+        append(sections[vlkm_faces], std::span{mesh.faces});
+
+        const vlkm_mesh record{.material_index = mesh.material_index,
+                               .first_face     = first_face,
+                               .face_count     = mesh.faces.size(),
+                               .has_tex_coords = mesh.has_tex_coords,
+                               .has_normals    = mesh.has_normals};
+
+        append_record(sections[vlkm_meshes], record);
+    }
+
+    for (const auto &material : model.materials) {
+        const vlkm_material record{.name      = append(sections[vlkm_strings], material.name),
+                                   .albedo    = material.albedo,
+                                   .normal    = material.normal,
+                                   .roughness = material.roughness,
+                                   .metallic  = material.metallic,
+                                   .opacity   = material.opacity};
+
+        append_record(sections[vlkm_materials], record);
+    }
+
+    for (const auto &image : model.images) {
+        const vlkm_image record{.width    = image.width(),
+                                .height   = image.height(),
+                                .channels = image.channels(),
+                                .pixels   = append(sections[vlkm_pixels], image.data())};
+
+        append_record(sections[vlkm_images], record);
+    }
+
+    for (const auto &texture : model.textures) {
+        const u64 first_level = sections[vlkm_levels].size() / sizeof(vlkm_level);
+
+        for (const auto &level : texture.levels()) {
+            const vlkm_level record{.width  = static_cast<u64>(level.width),
+                                    .height = static_cast<u64>(level.height),
+                                    .texels = append(sections[vlkm_pixels], std::span{level.texels}),
+                                    .blocks = append(sections[vlkm_pixels], std::span{level.blocks})};
+
+            append_record(sections[vlkm_levels], record);
+        }
+
+        const vlkm_texture record{.format           = static_cast<u32>(texture.format()),
+                                  .is_premultiplied = texture.is_premultiplied(),
+                                  .first_level      = first_level,
+                                  .level_count      = texture.levels().size()};
+
+        append_record(sections[vlkm_textures], record);
+    }
+
+    vlkm_header header{.magic = vlkm_magic, .version = vlkm_version, .key = key, .sections{}};
+
+    size_t offset = align_up(sizeof(header));
+
+    for (size_t i = 0; i < vlkm_section_count; ++i) {
+        header.sections[i] = {.offset = offset, .size = sections[i].size()};
+        offset             = align_up(offset + sections[i].size());
+    }
+
+    // Written next to the file and renamed over it, so a file that is being read is never half written.
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+
+    try {
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+
+            if (!file.is_open()) {
+                throw std::runtime_error(std::format("Valkyrie: failed to write {}.", path.string()));
+            }
+
+            const std::array<char, vlkm_alignment> padding{};
+            const size_t header_padding = header.sections[0].offset - sizeof(header);
+
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(padding.data(), static_cast<std::streamsize>(header_padding));
+
+            for (size_t i = 0; i < vlkm_section_count; ++i) {
+                const size_t end = header.sections[i].offset + sections[i].size();
+
+                file.write(reinterpret_cast<const char *>(sections[i].data()),
+                           static_cast<std::streamsize>(sections[i].size()));
+                file.write(padding.data(), static_cast<std::streamsize>(align_up(end) - end));
+            }
+
+            if (!file) {
+                throw std::runtime_error(std::format("Valkyrie: failed to write {}.", path.string()));
+            }
+        }
+
+        std::filesystem::rename(temp_path, path);
+    } catch (...) {
+        std::error_code error;
+        std::filesystem::remove(temp_path, error);
+        throw;
+    }
+}
+
+// Reads the header of a .vlkm file, false if it isn't one or its sections don't fit in the file.
+static bool read_vlkm_header(std::span<const u8> data, vlkm_header &header) {
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    if (header.magic != vlkm_magic || header.version != vlkm_version) {
+        return false;
+    }
+
+    for (const auto &section : header.sections) {
+        if (section.offset % vlkm_alignment != 0 || section.offset > data.size() ||
+            section.size > data.size() - section.offset) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The values of a section, or of a range within it. The mapping is page aligned, so they are aligned too.
+template <typename T>
+static std::span<const T> read_section(std::span<const u8> data, const vlkm_header &header,
+                                       vlkm_section section, vlkm_range range,
+                                       const std::filesystem::path &path) {
+    const vlkm_range &bounds = header.sections[section];
+
+    if (range.offset > bounds.size || range.size > bounds.size - range.offset ||
+        range.size % sizeof(T) != 0 || (bounds.offset + range.offset) % alignof(T) != 0) {
+        throw invalid_vlkm_error(path);
+    }
+
+    return {reinterpret_cast<const T *>(data.data() + bounds.offset + range.offset), range.size / sizeof(T)};
+}
+
+template <typename T>
+static std::span<const T> read_section(std::span<const u8> data, const vlkm_header &header,
+                                       vlkm_section section, const std::filesystem::path &path) {
+    return read_section<T>(data, header, section, {.offset = 0, .size = header.sections[section].size}, path);
+}
+
+bool vlk::is_vlkm_current(std::filesystem::path path, u64 key) {
+    // Files that are missing, empty, locked or otherwise unreadable aren't current.
+    try {
+        if (!std::filesystem::exists(path)) {
+            return false;
+        }
+
+        const mapped_file file{path};
+
+        vlkm_header header;
+
+        if (!read_vlkm_header(file.data(), header) || header.key != key) {
+            return false;
+        }
+
+        for (const auto &source : read_section<vlkm_source>(file.data(), header, vlkm_sources, path)) {
+            const auto utf8 = read_section<char8_t>(file.data(), header, vlkm_strings, source.path, path);
+
+            std::error_code error;
+            const auto [size, write_time] = file_stamp(std::u8string{utf8.begin(), utf8.end()}, error);
+
+            if (error || size != source.size || write_time != source.write_time) {
+                return false;
+            }
+        }
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+
+    return true;
+}
+
+model vlk::load_vlkm(std::filesystem::path path, bool compress_textures, bool premultiply_alpha) {
+    const mapped_file file{path};
+    const std::span<const u8> data = file.data();
+
+    vlkm_header header;
+
+    if (!read_vlkm_header(data, header)) {
+        throw invalid_vlkm_error(path);
+    }
+
+    model model;
+
+    const auto positions  = read_section<vec3f>(data, header, vlkm_positions, path);
+    const auto tex_coords = read_section<vec2f>(data, header, vlkm_tex_coords, path);
+    const auto normals    = read_section<vec3f>(data, header, vlkm_normals, path);
+
+    model.positions.assign(positions.begin(), positions.end());
+    model.tex_coords.assign(tex_coords.begin(), tex_coords.end());
+    model.normals.assign(normals.begin(), normals.end());
+
+    const auto faces     = read_section<model::mesh::face>(data, header, vlkm_faces, path);
+    const auto materials = read_section<vlkm_material>(data, header, vlkm_materials, path);
+    const auto images    = read_section<vlkm_image>(data, header, vlkm_images, path);
+    const auto textures  = read_section<vlkm_texture>(data, header, vlkm_textures, path);
+    const auto levels    = read_section<vlkm_level>(data, header, vlkm_levels, path);
+
+    // Meshes have their faces one after the other, so each face is copied once.
+    size_t next_face = 0;
+
+    for (const auto &mesh : read_section<vlkm_mesh>(data, header, vlkm_meshes, path)) {
+        // Indices are checked here, the renderer uses them as they are.
+        if (mesh.first_face != next_face || mesh.face_count > faces.size() - mesh.first_face ||
+            (mesh.material_index != model::null_index && mesh.material_index >= materials.size())) {
+            throw invalid_vlkm_error(path);
+        }
+
+        const auto mesh_faces = faces.subspan(mesh.first_face, mesh.face_count);
+        next_face += mesh.face_count;
+
+        for (const auto &face : mesh_faces) {
+            for (size_t i = 0; i < 3; ++i) {
+                if (face.positions[i] >= positions.size() ||
+                    (mesh.has_tex_coords && face.tex_coords[i] >= tex_coords.size()) ||
+                    (mesh.has_normals && face.normals[i] >= normals.size())) {
+                    throw invalid_vlkm_error(path);
+                }
+            }
+        }
+
+        model.meshes.push_back({.material_index{mesh.material_index},
+                                .has_tex_coords{mesh.has_tex_coords != 0},
+                                .has_normals{mesh.has_normals != 0},
+                                .faces{mesh_faces.begin(), mesh_faces.end()}});
+    }
+
+    // Materials index the textures, or the images when there are more of them. Compressed models keep none.
+    const size_t image_count = std::max(images.size(), textures.size());
+
+    for (const auto &material : materials) {
+        const auto name = read_section<char>(data, header, vlkm_strings, material.name, path);
+
+        for (const u64 index : {material.albedo, material.normal, material.roughness, material.metallic,
+                                material.opacity}) {
+            if (index != model::null_index && index >= image_count) {
+                throw invalid_vlkm_error(path);
+            }
+        }
+
+        model.materials.push_back({.name{name.begin(), name.end()},
+                                   .albedo{material.albedo},
+                                   .normal{material.normal},
+                                   .roughness{material.roughness},
+                                   .metallic{material.metallic},
+                                   .opacity{material.opacity}});
+    }
+
+    for (const auto &image : images) {
+        const auto pixels = read_section<u8>(data, header, vlkm_pixels, image.pixels, path);
+
+        // Sizes are divided rather than multiplied, so ones that overflow don't match.
+        if ((image.channels != 3 && image.channels != 4) || image.width == 0 || image.width > pixels.size() ||
+            pixels.size() % (image.width * image.channels) != 0 ||
+            pixels.size() / (image.width * image.channels) != image.height || image.height == 0) {
+            throw invalid_vlkm_error(path);
+        }
+
+        vlk::image &result = model.images.emplace_back(image.width, image.height, image.channels);
+        std::memcpy(result.data().data(), pixels.data(), pixels.size());
+    }
+
+    const bool is_built_alike = std::ranges::all_of(textures, [&](const vlkm_texture &texture) {
+        return (texture.format != static_cast<u32>(texture_format::rgba8)) == compress_textures &&
+               (texture.is_premultiplied != 0) == premultiply_alpha;
+    });
+
+    // Textures that were built with other options are built again, which needs the images they were built
+    // from. Those aren't kept with compressed textures.
+    if (!is_built_alike || textures.size() < model.images.size()) {
+        if (model.images.size() < textures.size()) {
+            throw std::runtime_error(std::format(
+                "Valkyrie: {} was saved with other texture options and without images.", path.string()));
+        }
+
+        model.build_textures(compress_textures, premultiply_alpha);
+        return model;
+    }
+
+    for (const auto &texture : textures) {
+        if (texture.format > static_cast<u32>(texture_format::bc3) || texture.first_level > levels.size() ||
+            texture.level_count == 0 || texture.level_count > levels.size() - texture.first_level) {
+            throw invalid_vlkm_error(path);
+        }
+
+        const auto format      = static_cast<texture_format>(texture.format);
+        const u64 block_size   = format == texture_format::bc3 ? 2 : 1;
+        const auto level_range = levels.subspan(texture.first_level, texture.level_count);
+
+        u64 width  = level_range[0].width;
+        u64 height = level_range[0].height;
+
+        // Each level is half the size of the one before it, down to 1x1, like the texture constructor builds.
+        if (level_range.size() != std::bit_width(std::max(width, height))) {
+            throw invalid_vlkm_error(path);
+        }
+
+        std::vector<texture::level> texture_levels;
+
+        for (const auto &level : level_range) {
+            const auto texels = read_section<color_rgba>(data, header, vlkm_pixels, level.texels, path);
+            const auto blocks = read_section<u64>(data, header, vlkm_pixels, level.blocks, path);
+
+            const bool is_compressed = format != texture_format::rgba8;
+            const u64 texel_count    = is_compressed ? 0 : width * height;
+            const u64 block_count    = is_compressed ? (width + 3) / 4 * ((height + 3) / 4) * block_size : 0;
+
+            if (width == 0 || height == 0 || width > std::numeric_limits<i32>::max() ||
+                height > std::numeric_limits<i32>::max() || level.width != width || level.height != height ||
+                texels.size() != texel_count || blocks.size() != block_count) {
+                throw invalid_vlkm_error(path);
+            }
+
+            texture_levels.push_back({.width{static_cast<i32>(width)},
+                                      .height{static_cast<i32>(height)},
+                                      .is_power_of_two{},
+                                      .texels{texels.begin(), texels.end()},
+                                      .blocks{blocks.begin(), blocks.end()}});
+
+            width  = std::max<u64>(width / 2, 1);
+            height = std::max<u64>(height / 2, 1);
+        }
+
+        model.textures.emplace_back(std::move(texture_levels), format, texture.is_premultiplied != 0);
+    }
+
+    return model;
+}
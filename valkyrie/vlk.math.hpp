@@ -54,6 +54,32 @@ namespace vlk {
         std::array<vec4f, 4> m_elems;
     };
 
+    template <typename T>
+    vec3<T> vec3<T>::operator*(const mat3 &m) const {
+        vec3<T> result;
+        for (int y = 0; y < 3; y++) {
+            float i = 0;
+            for (int x = 0; x < 3; x++) {
+                i += m[x][y] * (*this)[x];
+            }
+            result[y] = i;
+        }
+        return result;
+    }
+
+    template <typename T>
+    vec4<T> vec4<T>::operator*(const mat4 &m) const {
+        vec4<T> result;
+        for (int y = 0; y < 4; y++) {
+            float i = 0;
+            for (int x = 0; x < 4; x++) {
+                i += m[x][y] * (*this)[x];
+            }
+            result[y] = i;
+        }
+        return result;
+    }
+
     mat4 look_at(vec3f pos, vec3f target, vec3f up);
     mat4 perspective(f32 aspect, f32 fov, f32 near, f32 far);
 
@@ -0,0 +1,213 @@
+#include "vlk.pixels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+using namespace vlk;
+
+void vlk::convert_rgba_to_bgra(std::span<u8> dst, std::span<const u8> src) {
+    VLK_ASSERT(dst.size() == src.size() && src.size() % 4 == 0, "Pixel counts must match.");
+
+    const size_t count = src.size() / 4;
+    size_t i           = 0;
+
+#if defined(VLK_AVX2)
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3,
+                                             6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src.data() + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst.data() + i * 4),
+                            _mm256_shuffle_epi8(pixels, shuffle));
+    }
+#elif defined(VLK_SSE2)
+    const __m128i keep_mask = _mm_set1_epi32(static_cast<i32>(0xff00ff00));
+    const __m128i low_mask  = _mm_set1_epi32(0x000000ff);
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src.data() + i * 4));
+        const __m128i red    = _mm_slli_epi32(_mm_and_si128(pixels, low_mask), 16);
+        const __m128i blue   = _mm_and_si128(_mm_srli_epi32(pixels, 16), low_mask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst.data() + i * 4),
+                         _mm_or_si128(_mm_and_si128(pixels, keep_mask), _mm_or_si128(red, blue)));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        u32 pixel;
+        std::memcpy(&pixel, src.data() + i * 4, sizeof(pixel));
+
+        // AABBGGRR to AARRGGBB.
+        pixel = (pixel & 0xff00ff00) | ((pixel & 0x00ff0000) >> 16) | ((pixel & 0x000000ff) << 16);
+        std::memcpy(dst.data() + i * 4, &pixel, sizeof(pixel));
+    }
+}
+
+void vlk::convert_rgb_to_rgba(std::span<u8> dst, std::span<const u8> src) {
+    VLK_ASSERT(src.size() % 3 == 0 && dst.size() == src.size() / 3 * 4, "Pixel counts must match.");
+
+    const size_t count = src.size() / 3;
+    size_t i           = 0;
+
+#if defined(VLK_AVX2)
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2,
+                                             -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha   = _mm256_set1_epi32(static_cast<i32>(0xff000000));
+
+    // Four pixels per 128-bit lane, loaded 16 bytes at a time so the last 4 bytes read belong to the next
+    // pixels.
+    for (; (i + 8) * 3 + 4 <= count * 3; i += 8) {
+        const u8 *pixels  = src.data() + i * 3;
+        const __m256i rgb = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 12)), 1);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst.data() + i * 4),
+                            _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), alpha));
+    }
+#endif
+
+    // All but the last pixel can be read as 4 bytes.
+    for (; i + 1 < count; ++i) {
+        u32 pixel;
+        std::memcpy(&pixel, src.data() + i * 3, sizeof(pixel));
+
+        pixel |= 0xff000000;
+        std::memcpy(dst.data() + i * 4, &pixel, sizeof(pixel));
+    }
+
+    for (; i < count; ++i) {
+        dst[i * 4 + 0] = src[i * 3 + 0];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 255;
+    }
+}
+
+void vlk::premultiply_alpha(std::span<u8> dst, std::span<const u8> src) {
+    VLK_ASSERT(dst.size() == src.size() && src.size() % 4 == 0, "Pixel counts must match.");
+
+    const size_t count = src.size() / 4;
+    size_t i           = 0;
+
+#if defined(VLK_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+
+    // The alpha lanes are multiplied by 255, which leaves them as they are.
+    const __m128i alpha_lanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    const __m128i max         = _mm_and_si128(alpha_lanes, _mm_set1_epi16(255));
+
+    auto premultiply_2 = [&](__m128i pixels16) {
+        const __m128i alpha16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels16, _MM_SHUFFLE(3, 3, 3, 3)),
+                                                    _MM_SHUFFLE(3, 3, 3, 3));
+        const __m128i factor16 = _mm_or_si128(_mm_andnot_si128(alpha_lanes, alpha16), max);
+        return div_255_epu16(_mm_mullo_epi16(pixels16, factor16));
+    };
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src.data() + i * 4));
+        const __m128i lo     = premultiply_2(_mm_unpacklo_epi8(pixels, zero));
+        const __m128i hi     = premultiply_2(_mm_unpackhi_epi8(pixels, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst.data() + i * 4), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const u32 alpha = src[i * 4 + 3];
+
+        for (size_t c = 0; c < 3; ++c) {
+            dst[i * 4 + c] = static_cast<u8>(div_255(src[i * 4 + c] * alpha));
+        }
+        dst[i * 4 + 3] = static_cast<u8>(alpha);
+    }
+}
+
+void vlk::unpremultiply_alpha(std::span<u8> dst, std::span<const u8> src) {
+    VLK_ASSERT(dst.size() == src.size() && src.size() % 4 == 0, "Pixel counts must match.");
+
+    // 255 / alpha in 16.16 fixed point, rounded up so exact multiples of alpha come out exact.
+    static const std::array<u32, 256> reciprocals = [] {
+        std::array<u32, 256> reciprocals{};
+
+        for (u32 alpha = 1; alpha < 256; ++alpha) {
+            reciprocals[alpha] = (255 * 65536 + alpha - 1) / alpha;
+        }
+
+        return reciprocals;
+    }();
+
+    // A division per channel doesn't vectorize, the table lookup per pixel keeps this a multiply.
+    for (size_t i = 0; i < src.size(); i += 4) {
+        const u32 alpha      = src[i + 3];
+        const u32 reciprocal = reciprocals[alpha];
+
+        for (size_t c = 0; c < 3; ++c) {
+            const u32 color = std::min<u32>(src[i + c], alpha);
+            dst[i + c]      = static_cast<u8>(std::min<u32>((color * reciprocal + 32768) >> 16, 255));
+        }
+        dst[i + 3] = static_cast<u8>(alpha);
+    }
+}
+
+void vlk::convert_u8_to_f32(std::span<f32> dst, std::span<const u8> src) {
+    VLK_ASSERT(dst.size() == src.size(), "Channel counts must match.");
+
+    constexpr f32 scale = 1.0f / 255.0f;
+
+    size_t i = 0;
+
+#if defined(VLK_AVX2)
+    for (; i + 8 <= src.size(); i += 8) {
+        const __m128i channels = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src.data() + i));
+        const __m256 values     = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(channels));
+        _mm256_storeu_ps(dst.data() + i, _mm256_mul_ps(values, _mm256_set1_ps(scale)));
+    }
+#elif defined(VLK_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= src.size(); i += 8) {
+        const __m128i channels   = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src.data() + i));
+        const __m128i channels16 = _mm_unpacklo_epi8(channels, zero);
+
+        const __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(channels16, zero));
+        const __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(channels16, zero));
+
+        _mm_storeu_ps(dst.data() + i + 0, _mm_mul_ps(lo, _mm_set1_ps(scale)));
+        _mm_storeu_ps(dst.data() + i + 4, _mm_mul_ps(hi, _mm_set1_ps(scale)));
+    }
+#endif
+
+    for (; i < src.size(); ++i) {
+        dst[i] = static_cast<f32>(src[i]) * scale;
+    }
+}
+
+void vlk::convert_f32_to_u8(std::span<u8> dst, std::span<const f32> src) {
+    VLK_ASSERT(dst.size() == src.size(), "Channel counts must match.");
+
+    size_t i = 0;
+
+#if defined(VLK_SSE2)
+    // Max returns its second operand for NaN, so NaN becomes 0 like in the scalar path.
+    auto to_i32 = [](__m128 values) {
+        values = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(values, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+    };
+
+    for (; i + 8 <= src.size(); i += 8) {
+        const __m128i lo = to_i32(_mm_loadu_ps(src.data() + i + 0));
+        const __m128i hi = to_i32(_mm_loadu_ps(src.data() + i + 4));
+
+        const __m128i channels = _mm_packus_epi16(_mm_packs_epi32(lo, hi), _mm_setzero_si128());
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst.data() + i), channels);
+    }
+#endif
+
+    for (; i < src.size(); ++i) {
+        const f32 value = src[i] > 0.0f ? std::min(src[i], 1.0f) : 0.0f;
+        dst[i]          = static_cast<u8>(static_cast<i32>(value * 255.0f + 0.5f));
+    }
+}
\ No newline at end of file
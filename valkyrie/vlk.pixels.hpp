@@ -0,0 +1,47 @@
+#pragma once
+
+#include <span>
+
+#include "vlk.types.hpp"
+
+/*
+ * Pixel format conversion.
+ *
+ * Pixels are 8 bits per channel, stored in channel order, e.g. RGBA is R, G, B and then A in memory. Each
+ * function converts all of src into dst, which must hold exactly as many pixels. Conversions that keep the
+ * pixel size may be done in place.
+ *
+ * NOTE: The kernels are picked at compile time from the SIMD instruction sets in vlk.types.hpp, with a
+ *       scalar fallback. They all give the same results.
+ */
+namespace vlk {
+    // x / 255, rounded to the nearest integer, for x in [0, 255 * 255]. Shared by the pixel conversions and
+    // the color blends so they round the same.
+    inline u32 div_255(u32 x) {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+#if defined(VLK_SSE2)
+    // div_255() for each 16-bit lane.
+    inline __m128i div_255_epu16(__m128i x) {
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+#endif
+
+    // Swaps the R and B channels, which also converts BGRA to RGBA.
+    void convert_rgba_to_bgra(std::span<u8> dst, std::span<const u8> src);
+
+    // The alpha of dst is 255.
+    void convert_rgb_to_rgba(std::span<u8> dst, std::span<const u8> src);
+
+    // RGBA to RGBA with the colors multiplied by alpha, and back. Unpremultiplying a fully transparent pixel
+    // gives transparent black.
+    void premultiply_alpha(std::span<u8> dst, std::span<const u8> src);
+    void unpremultiply_alpha(std::span<u8> dst, std::span<const u8> src);
+
+    // Channels in [0, 255] to [0, 1] and back. Floats are clamped to [0, 1] and rounded.
+    void convert_u8_to_f32(std::span<f32> dst, std::span<const u8> src);
+    void convert_f32_to_u8(std::span<u8> dst, std::span<const f32> src);
+}  // namespace vlk
\ No newline at end of file
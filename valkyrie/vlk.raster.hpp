@@ -0,0 +1,796 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <span>
+#include <bit>
+#include <algorithm>
+
+#include "vlk.types.hpp"
+#include "vlk.gfx.hpp"
+#include "vlk.util.hpp"
+
+/*
+ * Rasterizer core behind the render_* functions in vlk.gfx.hpp.
+ *
+ * Everything that touches pixels is templated on the pixel shader and color blend function so they can be
+ * inlined. Setup work that doesn't depend on them lives in vlk.gfx.cpp.
+ */
+
+namespace vlk::raster {
+    // State shared by every triangle of a draw call.
+    template <typename PixelShader, typename ColorBlend>
+    struct state {
+        optional_ref<color_buffer> color_buf;
+        optional_ref<depth_buffer> depth_buf;
+        const PixelShader *pixel_shader;
+        const ColorBlend *color_blend;
+        cull_mode cull;
+    };
+
+    vec2i framebuffer_size(const optional_ref<color_buffer> &color_buf,
+                           const optional_ref<depth_buffer> &depth_buf);
+
+    // Transform a position from clip space to screen space.
+    // NOTE: The position MUST be inside of the clip planes, see outcode().
+    vec4f setup_position(vec4f pos, vec2i framebuffer_size);
+
+    // Transform a vertex from clip space to screen space.
+    // NOTE: The vertex MUST be inside of the clip planes, see outcode().
+    void setup_vertex(vertex &vertex, vec2i framebuffer_size);
+
+    // Transform a triangle from clip space to screen space.
+    // NOTE: The entire triangle MUST be inside of the clip planes, see outcode().
+    std::array<vertex, 3> setup(std::array<vertex, 3> vertices, vec2i framebuffer_size);
+
+    /*
+     * Clipping.
+     *
+     * Triangles are only clipped against the near and far planes and a guard band far outside of the screen.
+     * Whatever lies between the screen and the guard band is cut off by the rasterizer's scissor rect, so
+     * most triangles that stick out of the screen never reach the clipper. The guard band keeps screen space
+     * coordinates small enough for the rasterizer's integer edge functions.
+     */
+
+    // Furthest a vertex can end up from the screen's origin, in pixels.
+    constexpr f32 guard_band_size = 8192.0f;
+
+    // The guard band in normalized device coordinates.
+    inline vec2f guard_band(vec2i framebuffer_size) {
+        auto ndc = [](i32 size) {
+            return std::max(2.0f * guard_band_size / static_cast<f32>(std::max(size, 1)) - 1.0f, 1.0f);
+        };
+
+        return {ndc(framebuffer_size.x()), ndc(framebuffer_size.y())};
+    }
+
+    // Outcode bits of the planes a triangle is clipped against: guard band left, right, bottom and top,
+    // then near and far.
+    constexpr u32 clip_planes = 0b0000111111;
+
+    // Outcode bits of the view volume: near and far, then left, right, bottom and top.
+    constexpr u32 view_planes = 0b1111110000;
+
+    // One bit per plane the position is outside of.
+    inline u32 outcode(const vec4f &p, const vec2f &guard_band) {
+        const f32 guard_x = guard_band.x() * p.w();
+        const f32 guard_y = guard_band.y() * p.w();
+
+        return (p.x() < -guard_x) << 0 | (p.x() > guard_x) << 1 | (p.y() < -guard_y) << 2 |
+               (p.y() > guard_y) << 3 | (p.z() < -p.w()) << 4 | (p.z() > p.w()) << 5 | (p.x() < -p.w()) << 6 |
+               (p.x() > p.w()) << 7 | (p.y() < -p.w()) << 8 | (p.y() > p.w()) << 9;
+    }
+
+    // The triangle is entirely outside of one of the view volume's planes.
+    inline bool is_outside(u32 outcode_0, u32 outcode_1, u32 outcode_2) {
+        return (outcode_0 & outcode_1 & outcode_2 & view_planes) != 0;
+    }
+
+    // The triangle doesn't need clipping.
+    inline bool is_inside(u32 outcode_0, u32 outcode_1, u32 outcode_2) {
+        return ((outcode_0 | outcode_1 | outcode_2) & clip_planes) == 0;
+    }
+
+    // Convex polygon with room for a triangle clipped against every clip plane.
+    struct polygon {
+        std::array<vertex, 9> vertices;
+        u32 count = 0;
+    };
+
+    // Clip a triangle against the planes whose outcode bits are set in planes. Empty if nothing is visible.
+    polygon clip(const std::array<vertex, 3> &vertices, u32 planes, const vec2f &guard_band);
+
+    // Call emit() with every visible part of a clip space triangle.
+    template <typename F>
+    void clip_triangle(const std::array<vertex, 3> &vertices, vec2i framebuffer_size, F &&emit) {
+        const vec2f guard = guard_band(framebuffer_size);
+
+        const u32 outcode_0 = outcode(vertices[0].pos, guard);
+        const u32 outcode_1 = outcode(vertices[1].pos, guard);
+        const u32 outcode_2 = outcode(vertices[2].pos, guard);
+
+        if (is_outside(outcode_0, outcode_1, outcode_2)) {
+            return;
+        }
+        if (is_inside(outcode_0, outcode_1, outcode_2)) {
+            emit(vertices);
+            return;
+        }
+
+        const polygon visible = clip(vertices, (outcode_0 | outcode_1 | outcode_2) & clip_planes, guard);
+
+        for (u32 i = 1; i + 1 < visible.count; ++i) {
+            emit(std::array<vertex, 3>{visible.vertices[0], visible.vertices[i], visible.vertices[i + 1]});
+        }
+    }
+
+    /*
+     * Half-space rasterization.
+     *
+     * Vertices are snapped to a fixed point grid and each edge of the triangle is described by an integer
+     * edge function which is >= 0 on the inside. Pixels are sampled at their centers. A pixel center exactly
+     * on an edge only belongs to the triangle if it's a top or left edge, so triangles that share an edge
+     * never both draw a pixel. The bounding box is walked in 8x8 blocks: blocks that are outside of an edge
+     * are rejected, blocks that are inside of all edges are filled without any per-pixel edge tests and only
+     * the remaining blocks test every pixel, a whole row of the block at a time with SIMD. Attributes are
+     * evaluated per pixel from plane equations set up once per triangle, so the value of a pixel doesn't
+     * depend on how the triangle is traversed, and only for pixels that pass the depth test.
+     */
+
+    // Blocks line up with the depth buffer's blocks so their depth bounds can be used.
+    constexpr i32 block_size = static_cast<i32>(depth_buffer::block_size);
+
+    // Sub-pixel precision of screen space positions. Together with the guard band this keeps the values of
+    // an edge function inside of a block within 32 bits, so pixels can be tested with 32 bit SIMD lanes.
+    constexpr i32 subpixel_bits  = 4;
+    constexpr i32 subpixel_scale = 1 << subpixel_bits;
+
+    // Fixed point version of a screen space position, which setup() has already snapped to the grid.
+    inline vec2i fixed_pos(const vec4f &pos) {
+        return {static_cast<i32>(pos.x() * subpixel_scale), static_cast<i32>(pos.y() * subpixel_scale)};
+    }
+
+    // Fixed point coordinate of the center of a pixel.
+    inline i64 pixel_center(i32 i) { return static_cast<i64>(i) * subpixel_scale + subpixel_scale / 2; }
+
+    struct edge {
+        i64 a;
+        i64 b;
+        i64 c;
+
+        i64 at(i64 x, i64 y) const { return a * x + b * y + c; }
+
+        // At the center of pixel (x, y).
+        i64 at_pixel(i32 x, i32 y) const { return at(pixel_center(x), pixel_center(y)); }
+    };
+
+    // Positive on the side of the line from p to q where triangles with positive area lie.
+    inline edge make_edge(const vec2i &p, const vec2i &q) {
+        return {static_cast<i64>(p.y()) - q.y(), static_cast<i64>(q.x()) - p.x(),
+                static_cast<i64>(p.x()) * q.y() - static_cast<i64>(p.y()) * q.x()};
+    }
+
+    // Twice the area of a screen space triangle in fixed point units, positive if it's counter-clockwise.
+    inline i64 signed_area(const vec4f &a, const vec4f &b, const vec4f &c) {
+        const vec2i p = fixed_pos(c);
+        return make_edge(fixed_pos(a), fixed_pos(b)).at(p.x(), p.y());
+    }
+
+    inline bool is_culled(cull_mode cull, i64 signed_area) {
+        return (cull == cull_mode::back && signed_area < 0) || (cull == cull_mode::front && signed_area > 0);
+    }
+
+    // An edge that crosses a block, so its values inside of the block fit in 32 bits.
+    struct block_edge {
+        i32 value;   // At the center of the block's first pixel.
+        i32 step_x;  // Per pixel.
+        i32 step_y;  // Per row.
+    };
+
+    // Bit i is set if pixel i of the block's row is inside all edges.
+    inline u32 coverage_mask(std::span<const block_edge> edges, i32 row) {
+#if defined(VLK_AVX2)
+        __m256i outside = _mm256_setzero_si256();
+
+        for (const block_edge &e : edges) {
+            const i32 v = e.value + e.step_y * row;
+            const i32 s = e.step_x;
+
+            const __m256i values =
+                _mm256_setr_epi32(v, v + s, v + s * 2, v + s * 3, v + s * 4, v + s * 5, v + s * 6, v + s * 7);
+
+            outside = _mm256_or_si256(outside, values);
+        }
+
+        // The sign bit of every lane that's outside any edge is set.
+        return ~static_cast<u32>(_mm256_movemask_ps(_mm256_castsi256_ps(outside))) & 0xff;
+#elif defined(VLK_SSE2)
+        __m128i outside_lo = _mm_setzero_si128();
+        __m128i outside_hi = _mm_setzero_si128();
+
+        for (const block_edge &e : edges) {
+            const i32 v = e.value + e.step_y * row;
+            const i32 s = e.step_x;
+
+            const __m128i lo = _mm_setr_epi32(v, v + s, v + s * 2, v + s * 3);
+            const __m128i hi = _mm_add_epi32(lo, _mm_set1_epi32(s * 4));
+
+            outside_lo = _mm_or_si128(outside_lo, lo);
+            outside_hi = _mm_or_si128(outside_hi, hi);
+        }
+
+        const u32 outside = static_cast<u32>(_mm_movemask_ps(_mm_castsi128_ps(outside_lo))) |
+                            static_cast<u32>(_mm_movemask_ps(_mm_castsi128_ps(outside_hi))) << 4;
+
+        return ~outside & 0xff;
+#else
+        u32 mask = (1u << block_size) - 1;
+
+        for (const block_edge &e : edges) {
+            const i32 v = e.value + e.step_y * row;
+
+            for (i32 i = 0; i < block_size; ++i) {
+                if (v + e.step_x * i < 0) {
+                    mask &= ~(1u << i);
+                }
+            }
+        }
+
+        return mask;
+#endif
+    }
+
+    // Rasterize a triangle in screen space. Only pixels inside the scissor rect (inclusive) are written.
+    template <typename PixelShader, typename ColorBlend>
+    void fill_triangle(const state<PixelShader, ColorBlend> &state, const rect<i32> &scissor, const vertex &a,
+                       const vertex &b, const vertex &c) {
+        const vertex *v0 = &a;
+        const vertex *v1 = &b;
+        const vertex *v2 = &c;
+
+        // Fixed point.
+        vec2i p0 = fixed_pos(v0->pos);
+        vec2i p1 = fixed_pos(v1->pos);
+        vec2i p2 = fixed_pos(v2->pos);
+
+        i64 area = make_edge(p0, p1).at(p2.x(), p2.y());
+
+        if (area == 0 || is_culled(state.cull, area)) {
+            return;
+        }
+
+        // Both windings are drawn, flip the negative ones so the inside is always positive.
+        if (area < 0) {
+            std::swap(v1, v2);
+            std::swap(p1, p2);
+            area = -area;
+        }
+
+        // Edge i is opposite of vertex i.
+        std::array<edge, 3> edges{make_edge(p1, p2), make_edge(p2, p0), make_edge(p0, p1)};
+
+        // Top-left rule. Only left edges (the inside is to the right) and top edges (horizontal, the inside
+        // is below) own the pixel centers exactly on them. The others are biased so >= 0 excludes those.
+        for (edge &e : edges) {
+            if (e.a < 0 || (e.a == 0 && e.b < 0)) {
+                e.c -= 1;
+            }
+        }
+
+        // Pixels whose centers can be inside of the triangle.
+        const i32 min_x = std::max(std::min({p0.x(), p1.x(), p2.x()}) >> subpixel_bits, scissor.start.x());
+        const i32 min_y = std::max(std::min({p0.y(), p1.y(), p2.y()}) >> subpixel_bits, scissor.start.y());
+        const i32 max_x = std::min(std::max({p0.x(), p1.x(), p2.x()}) >> subpixel_bits, scissor.end.x());
+        const i32 max_y = std::min(std::max({p0.y(), p1.y(), p2.y()}) >> subpixel_bits, scissor.end.y());
+
+        if (min_x > max_x || min_y > max_y) {
+            return;
+        }
+
+        const f32 inv_area = 1.0f / static_cast<f32>(area);
+
+        // Every value is interpolated as v0 + ddx * (x - x0) + ddy * (y - y0), in fixed point units. The
+        // gradients follow from the barycentric weights of v1 and v2, which are edges[1] / area and
+        // edges[2] / area.
+        auto gradients = [&](const vec4f &a0, const vec4f &a1, const vec4f &a2) {
+            const vec4f d1 = a1 - a0;
+            const vec4f d2 = a2 - a0;
+
+            const vec4f ddx = (d1 * static_cast<f32>(edges[1].a) + d2 * static_cast<f32>(edges[2].a)) *
+                              inv_area;
+            const vec4f ddy = (d1 * static_cast<f32>(edges[1].b) + d2 * static_cast<f32>(edges[2].b)) *
+                              inv_area;
+
+            return std::make_pair(ddx, ddy);
+        };
+
+        // Depth is linear in screen space, but attributes aren't. Attributes divided by w and 1 / w are, so
+        // those are interpolated instead and every pixel divides by its 1 / w to get perspective correct
+        // attributes. If w is the same everywhere (2D or orthographic) the attributes are linear already.
+        const bool is_perspective = v0->pos.w() != v1->pos.w() || v0->pos.w() != v2->pos.w();
+
+        const f32 inv_w0 = is_perspective ? 1.0f / v0->pos.w() : 1.0f;
+        const f32 inv_w1 = is_perspective ? 1.0f / v1->pos.w() : 1.0f;
+        const f32 inv_w2 = is_perspective ? 1.0f / v2->pos.w() : 1.0f;
+
+        const vec4f pos0 = {v0->pos.x(), v0->pos.y(), v0->pos.z(), inv_w0};
+
+        const auto [pos_ddx, pos_ddy] = gradients(pos0, {v1->pos.x(), v1->pos.y(), v1->pos.z(), inv_w1},
+                                                  {v2->pos.x(), v2->pos.y(), v2->pos.z(), inv_w2});
+
+        std::array<vec4f, VLK_MAX_ATTRIBUTES> attrib0;
+        std::array<vec4f, VLK_MAX_ATTRIBUTES> attrib_ddx;
+        std::array<vec4f, VLK_MAX_ATTRIBUTES> attrib_ddy;
+
+        for (u32 i = 0; i < v0->count; ++i) {
+            attrib0[i] = (*v0)[i].data * inv_w0;
+
+            std::tie(attrib_ddx[i], attrib_ddy[i]) =
+                gradients(attrib0[i], (*v1)[i].data * inv_w1, (*v2)[i].data * inv_w2);
+        }
+
+        // Attribute counts and sizes are taken from the first vertex, only the data is written per pixel.
+        vertex pixel = *v0;
+
+        // The pixels of a row of a block are contiguous in memory in either buffer layout, so they're
+        // addressed from the first pixel of the row.
+        auto shade = [&](i32 x, i32 y, bool is_depth_tested, f32 *depth_buf_z, color_rgba *dest) {
+            const f32 dx = static_cast<f32>(pixel_center(x) - p0.x());
+            const f32 dy = static_cast<f32>(pixel_center(y) - p0.y());
+
+            const f32 z = v0->pos.z() + pos_ddx.z() * dx + pos_ddy.z() * dy;
+
+            if (depth_buf_z) {
+                // If the pixel is invisible, do not run the pixel shader.
+                if (is_depth_tested && z >= *depth_buf_z) {
+                    return;
+                }
+
+                *depth_buf_z = z;
+            }
+
+            if (dest) {
+                const f32 w = is_perspective ? 1.0f / (pos0.w() + pos_ddx.w() * dx + pos_ddy.w() * dy)
+                                             : v0->pos.w();
+
+                pixel.pos = {static_cast<f32>(x), static_cast<f32>(y), z, w};
+
+                for (u32 i = 0; i < pixel.count; ++i) {
+                    pixel[i].data = (attrib0[i] + attrib_ddx[i] * dx + attrib_ddy[i] * dy) * w;
+                }
+
+                *dest = (*state.color_blend)(*dest, (*state.pixel_shader)(pixel));
+            }
+        };
+
+        // Per-pixel depth can be off from the plane through the block corners by a few rounding errors. Widen
+        // the depth range of a block by an upper bound on that, so the block bounds tests never disagree with
+        // the per-pixel depth test.
+        const i64 extent_x    = std::max(p0.x() - pixel_center(min_x), pixel_center(max_x) - p0.x()) +
+                                block_size * subpixel_scale;
+        const i64 extent_y    = std::max(p0.y() - pixel_center(min_y), pixel_center(max_y) - p0.y()) +
+                                block_size * subpixel_scale;
+        const f32 depth_error = 8.0f * std::numeric_limits<f32>::epsilon() *
+                                (std::abs(v0->pos.z()) + std::abs(pos_ddx.z()) * static_cast<f32>(extent_x) +
+                                 std::abs(pos_ddy.z()) * static_cast<f32>(extent_y));
+
+        constexpr i32 block_mask = ~(block_size - 1);
+
+        for (i32 block_y = min_y & block_mask; block_y <= max_y; block_y += block_size) {
+            for (i32 block_x = min_x & block_mask; block_x <= max_x; block_x += block_size) {
+                const i32 last_x = block_x + block_size - 1;
+                const i32 last_y = block_y + block_size - 1;
+
+                // Edge functions are linear so the corners hold the extremes of the block. Only the edges
+                // that cross the block need to be tested per pixel.
+                std::array<block_edge, 3> crossing_edges;
+                u32 crossing_count = 0;
+                bool is_rejected   = false;
+
+                for (const edge &e : edges) {
+                    const i64 c0 = e.at_pixel(block_x, block_y);
+                    const i64 c1 = e.at_pixel(last_x, block_y);
+                    const i64 c2 = e.at_pixel(block_x, last_y);
+                    const i64 c3 = e.at_pixel(last_x, last_y);
+
+                    if ((c0 & c1 & c2 & c3) < 0) {
+                        is_rejected = true;
+                        break;
+                    }
+                    if ((c0 | c1 | c2 | c3) < 0) {
+                        crossing_edges[crossing_count++] = {static_cast<i32>(c0),
+                                                            static_cast<i32>(e.a * subpixel_scale),
+                                                            static_cast<i32>(e.b * subpixel_scale)};
+                    }
+                }
+
+                if (is_rejected) {
+                    continue;
+                }
+
+                const bool is_accepted = crossing_count == 0;
+                const std::span<const block_edge> crossing{crossing_edges.data(), crossing_count};
+
+                // Pixels of the block that are inside the bounding box (and scissor rect).
+                const i32 start_x = std::max(block_x, min_x);
+                const i32 start_y = std::max(block_y, min_y);
+                const i32 end_x   = std::min(last_x, max_x);
+                const i32 end_y   = std::min(last_y, max_y);
+                const u32 x_mask  = ((1u << (end_x - start_x + 1)) - 1) << (start_x - block_x);
+
+                depth_buffer::bounds *bounds = nullptr;
+                f32 block_min_z              = 0.0f;
+                f32 block_max_z              = 0.0f;
+
+                if (state.depth_buf) {
+                    bounds = &state.depth_buf->get().block_bounds(block_x / block_size, block_y / block_size);
+
+                    // Depth is linear so the corners hold the extremes of the block here too.
+                    const f32 z = v0->pos.z() +
+                                  pos_ddx.z() * static_cast<f32>(pixel_center(block_x) - p0.x()) +
+                                  pos_ddy.z() * static_cast<f32>(pixel_center(block_y) - p0.y());
+                    const f32 z_dx = pos_ddx.z() * static_cast<f32>((block_size - 1) * subpixel_scale);
+                    const f32 z_dy = pos_ddy.z() * static_cast<f32>((block_size - 1) * subpixel_scale);
+
+                    block_min_z = z + std::min(z_dx, 0.0f) + std::min(z_dy, 0.0f) - depth_error;
+                    block_max_z = z + std::max(z_dx, 0.0f) + std::max(z_dy, 0.0f) + depth_error;
+
+                    // Entirely behind what's already been drawn.
+                    if (block_min_z >= bounds->max) {
+                        continue;
+                    }
+                }
+
+                // Entirely in front of what's already been drawn, every pixel passes the depth test.
+                const bool is_depth_tested = !bounds || block_max_z >= bounds->min;
+
+                for (i32 y = start_y; y <= end_y; ++y) {
+                    u32 mask = is_accepted ? x_mask : coverage_mask(crossing, y - block_y) & x_mask;
+
+                    if (mask == 0) {
+                        continue;
+                    }
+
+                    f32 *depth_row = state.depth_buf ? &state.depth_buf->get().at(block_x, y) : nullptr;
+                    color_rgba *color_row =
+                        state.color_buf ? &state.color_buf->get().at(block_x, y) : nullptr;
+
+                    while (mask != 0) {
+                        const i32 i = std::countr_zero(mask);
+                        shade(block_x + i, y, is_depth_tested, depth_row ? depth_row + i : nullptr,
+                              color_row ? color_row + i : nullptr);
+                        mask &= mask - 1;
+                    }
+                }
+
+                if (bounds) {
+                    const i32 depth_buf_last_x = static_cast<i32>(state.depth_buf->get().width()) - 1;
+                    const i32 depth_buf_last_y = static_cast<i32>(state.depth_buf->get().height()) - 1;
+
+                    bounds->min = std::min(bounds->min, block_min_z);
+
+                    // Every pixel of the block got the triangle's depth or a lower one.
+                    const bool is_covered = is_accepted && start_x == block_x && start_y == block_y &&
+                                            end_x == std::min(last_x, depth_buf_last_x) &&
+                                            end_y == std::min(last_y, depth_buf_last_y);
+
+                    if (is_covered) {
+                        bounds->max = std::min(bounds->max, block_max_z);
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename PixelShader, typename ColorBlend>
+    void draw_triangle(const state<PixelShader, ColorBlend> &state, const std::array<vertex, 3> &vertices) {
+        const vec2i size = framebuffer_size(state.color_buf, state.depth_buf);
+        const rect<i32> scissor{
+            {0,            0           },
+            {size.x() - 1, size.y() - 1}
+        };
+
+        clip_triangle(vertices, size, [&](const std::array<vertex, 3> &visible) {
+            const std::array<vertex, 3> screen = setup(visible, size);
+            fill_triangle(state, scissor, screen[0], screen[1], screen[2]);
+        });
+    }
+
+    /*
+     * Binned rasterization.
+     *
+     * Triangles are clipped and transformed to screen space up front, then binned into every screen tile
+     * their bounding box overlaps. Tiles are rasterized in parallel, each one drawing its triangles in
+     * submission order with a scissor rect, so no two threads ever write the same pixel and the result is
+     * identical to drawing the triangles one by one.
+     */
+
+    struct binned_triangle {
+        std::array<vertex, 3> vertices;  // Screen space.
+        size_t state;                    // Index into the draw's raster states.
+    };
+
+    struct tile_bins {
+        vec2i tile_count;
+
+        // Indices into the binned triangles, per tile.
+        std::vector<std::vector<u32>> bins;
+
+        rect<i32> tile_rect(size_t tile, vec2i framebuffer_size) const;
+    };
+
+    tile_bins bin_triangles(std::span<const binned_triangle> triangles, vec2i framebuffer_size);
+
+    template <typename PixelShader, typename ColorBlend>
+    void fill_binned(std::span<const binned_triangle> triangles,
+                     std::span<const state<PixelShader, ColorBlend>> states, vec2i framebuffer_size) {
+        const tile_bins tiles = bin_triangles(triangles, framebuffer_size);
+
+        thread_pool::global().parallel_for(tiles.bins.size(), [&](size_t tile) {
+            const rect<i32> scissor = tiles.tile_rect(tile, framebuffer_size);
+
+            for (u32 i : tiles.bins[tile]) {
+                const auto &vertices = triangles[i].vertices;
+                fill_triangle(states[triangles[i].state], scissor, vertices[0], vertices[1], vertices[2]);
+            }
+        });
+    }
+
+    // Adapts a model pixel shader to a regular pixel shader for one mesh.
+    template <typename PixelShader>
+    struct model_pixel_shader {
+        const PixelShader *pixel_shader;
+        const vlk::model *model;
+        size_t material_index;
+
+        color_rgba operator()(const vertex &vertex) const {
+            return (*pixel_shader)(vertex, *model, material_index);
+        }
+    };
+
+    // A model's positions and normals, transformed once per draw. Faces index into these instead of
+    // transforming each of their corners.
+    struct transformed_model {
+        std::vector<vec4f> clip_positions;
+        std::vector<vec4f> screen_positions;  // Only set for positions inside of the clip planes.
+        std::vector<u32> outcodes;
+        std::vector<vec3f> normals;
+
+        // Replaces the contents with model transformed. The buffers only grow, so once they fit the largest
+        // model drawn this doesn't allocate.
+        void transform(const model &model, const mat4 &mvp_matrix, const mat3 &normal_matrix,
+                       vec2i framebuffer_size);
+
+        // The calling thread's transformed_model, which render_model() reuses from draw to draw.
+        static transformed_model &scratch();
+    };
+
+    // Assemble the vertices of a face. Positions are read from either transformed_model::clip_positions or
+    // transformed_model::screen_positions.
+    std::array<vertex, 3> model_face_vertices(const model &model, const model::mesh &mesh,
+                                              const model::mesh::face &face, std::span<const vec4f> positions,
+                                              std::span<const vec3f> normals);
+
+    // Append the texture coordinate scale of a screen space triangle to its vertices as their last attribute:
+    // the log2 of how much the texture coordinates, the first attribute, change per pixel. Textures pick
+    // their mip level from it, see texture::level_of_detail().
+    void add_tex_coord_scale(std::array<vertex, 3> &vertices);
+}  // namespace vlk::raster
+
+template <typename PixelShader, typename ColorBlend>
+void vlk::render_triangle(const basic_render_triangle_params<PixelShader, ColorBlend> &params) {
+    VLK_ASSERT_FAST(params.color_buf || params.depth_buf,
+                    "Either a color buffer, depth buffer or both must be present.");
+
+    const raster::state<PixelShader, ColorBlend> state{
+        params.color_buf, params.depth_buf, &params.pixel_shader, &params.color_blend, params.cull};
+
+    raster::draw_triangle(state, params.vertices);
+}
+
+template <typename PixelShader, typename ColorBlend>
+void vlk::render_triangles(const basic_render_triangles_params<PixelShader, ColorBlend> &params) {
+    VLK_ASSERT_FAST(params.color_buf || params.depth_buf,
+                    "Either a color buffer, depth buffer or both must be present.");
+
+    const raster::state<PixelShader, ColorBlend> state{
+        params.color_buf, params.depth_buf, &params.pixel_shader, &params.color_blend, params.cull};
+
+    if (!params.multithreaded) {
+        for (const auto &vertices : params.triangles) {
+            raster::draw_triangle(state, vertices);
+        }
+        return;
+    }
+
+    const vec2i size = raster::framebuffer_size(params.color_buf, params.depth_buf);
+
+    std::vector<raster::binned_triangle> triangles;
+    triangles.reserve(params.triangles.size());
+
+    for (const auto &vertices : params.triangles) {
+        raster::clip_triangle(vertices, size, [&](const std::array<vertex, 3> &visible) {
+            const std::array<vertex, 3> screen = raster::setup(visible, size);
+            const i64 area = raster::signed_area(screen[0].pos, screen[1].pos, screen[2].pos);
+
+            if (!raster::is_culled(params.cull, area)) {
+                triangles.push_back({screen, 0});
+            }
+        });
+    }
+
+    raster::fill_binned(std::span<const raster::binned_triangle>{triangles},
+                        std::span<const raster::state<PixelShader, ColorBlend>>{&state, 1}, size);
+}
+
+template <typename PixelShader, typename ColorBlend>
+void vlk::render_indexed(const basic_render_indexed_params<PixelShader, ColorBlend> &params) {
+    VLK_ASSERT_FAST(params.color_buf || params.depth_buf,
+                    "Either a color buffer, depth buffer or both must be present.");
+    VLK_ASSERT_FAST(params.indices.size() % 3 == 0, "Indices must come in groups of three.");
+
+    const raster::state<PixelShader, ColorBlend> state{
+        params.color_buf, params.depth_buf, &params.pixel_shader, &params.color_blend, params.cull};
+
+    const vec2i size = raster::framebuffer_size(params.color_buf, params.depth_buf);
+    const rect<i32> scissor{
+        {0,            0           },
+        {size.x() - 1, size.y() - 1}
+    };
+
+    u32 attrib_count = 0;
+    while (attrib_count < VLK_MAX_ATTRIBUTES && !params.attribs[attrib_count].empty()) {
+        attrib_count++;
+    }
+
+    auto clip_space_vertex = [&](u32 i) {
+        vertex vertex{params.positions[i], attrib_count};
+
+        for (u32 j = 0; j < attrib_count; ++j) {
+            vertex[j] = params.attribs[j][i];
+        }
+
+        return vertex;
+    };
+
+    // Classify every vertex and transform the ones inside of the clip planes to screen space.
+    const vec2f guard_band = raster::guard_band(size);
+
+    std::vector<u32> outcodes(params.positions.size());
+    std::vector<vertex> screen_vertices(params.positions.size());
+
+    for (u32 i = 0; i < params.positions.size(); ++i) {
+        outcodes[i] = raster::outcode(params.positions[i], guard_band);
+
+        if ((outcodes[i] & raster::clip_planes) == 0) {
+            screen_vertices[i] = clip_space_vertex(i);
+            raster::setup_vertex(screen_vertices[i], size);
+        }
+    }
+
+    std::vector<raster::binned_triangle> triangles;
+
+    auto emit = [&](const vertex &a, const vertex &b, const vertex &c) {
+        if (raster::is_culled(params.cull, raster::signed_area(a.pos, b.pos, c.pos))) {
+            return;
+        }
+
+        if (params.multithreaded) {
+            triangles.push_back({{a, b, c}, 0});
+        } else {
+            raster::fill_triangle(state, scissor, a, b, c);
+        }
+    };
+
+    for (size_t i = 0; i < params.indices.size(); i += 3) {
+        const u32 i0 = params.indices[i + 0];
+        const u32 i1 = params.indices[i + 1];
+        const u32 i2 = params.indices[i + 2];
+
+        if (raster::is_outside(outcodes[i0], outcodes[i1], outcodes[i2])) {
+            continue;
+        }
+        if (raster::is_inside(outcodes[i0], outcodes[i1], outcodes[i2])) {
+            emit(screen_vertices[i0], screen_vertices[i1], screen_vertices[i2]);
+            continue;
+        }
+
+        raster::clip_triangle({clip_space_vertex(i0), clip_space_vertex(i1), clip_space_vertex(i2)}, size,
+                              [&](const std::array<vertex, 3> &visible) {
+                                  const std::array<vertex, 3> screen = raster::setup(visible, size);
+                                  emit(screen[0], screen[1], screen[2]);
+                              });
+    }
+
+    if (params.multithreaded) {
+        raster::fill_binned(std::span<const raster::binned_triangle>{triangles},
+                            std::span<const raster::state<PixelShader, ColorBlend>>{&state, 1}, size);
+    }
+}
+
+template <typename PixelShader, typename ColorBlend>
+void vlk::render_model(const basic_render_model_params<PixelShader, ColorBlend> &params) {
+    VLK_ASSERT_FAST(params.color_buf || params.depth_buf,
+                    "Either a color buffer, depth buffer or both must be present.");
+
+    using mesh_pixel_shader = raster::model_pixel_shader<PixelShader>;
+
+    // One pixel shader per mesh, bound to the mesh's material.
+    std::vector<mesh_pixel_shader> pixel_shaders;
+    pixel_shaders.reserve(params.model.meshes.size());
+
+    for (const auto &mesh : params.model.meshes) {
+        pixel_shaders.push_back({&params.pixel_shader, &params.model, mesh.material_index});
+    }
+
+    std::vector<raster::state<mesh_pixel_shader, ColorBlend>> states;
+    states.reserve(pixel_shaders.size());
+
+    for (const auto &pixel_shader : pixel_shaders) {
+        states.push_back(
+            {params.color_buf, params.depth_buf, &pixel_shader, &params.color_blend, params.cull});
+    }
+
+    const vec2i size = raster::framebuffer_size(params.color_buf, params.depth_buf);
+    const rect<i32> scissor{
+        {0,            0           },
+        {size.x() - 1, size.y() - 1}
+    };
+
+    raster::transformed_model &transformed = raster::transformed_model::scratch();
+    transformed.transform(params.model, params.mvp_matrix, params.normal_matrix, size);
+
+    std::vector<raster::binned_triangle> triangles;
+
+    for (size_t i = 0; i < params.model.meshes.size(); ++i) {
+        const model::mesh &mesh = params.model.meshes[i];
+
+        auto emit = [&](std::array<vertex, 3> vertices) {
+            if (mesh.has_tex_coords) {
+                raster::add_tex_coord_scale(vertices);
+            }
+
+            if (params.multithreaded) {
+                triangles.push_back({vertices, i});
+            } else {
+                raster::fill_triangle(states[i], scissor, vertices[0], vertices[1], vertices[2]);
+            }
+        };
+
+        for (const auto &face : mesh.faces) {
+            const u32 outcode0 = transformed.outcodes[face.positions[0]];
+            const u32 outcode1 = transformed.outcodes[face.positions[1]];
+            const u32 outcode2 = transformed.outcodes[face.positions[2]];
+
+            if (raster::is_outside(outcode0, outcode1, outcode2)) {
+                continue;
+            }
+            if (raster::is_inside(outcode0, outcode1, outcode2)) {
+                const i64 area = raster::signed_area(transformed.screen_positions[face.positions[0]],
+                                                     transformed.screen_positions[face.positions[1]],
+                                                     transformed.screen_positions[face.positions[2]]);
+
+                // Cull before the vertices are assembled, clipped triangles are culled by the rasterizer.
+                if (!raster::is_culled(params.cull, area)) {
+                    emit(raster::model_face_vertices(params.model, mesh, face, transformed.screen_positions,
+                                                     transformed.normals));
+                }
+                continue;
+            }
+
+            const std::array<vertex, 3> vertices = raster::model_face_vertices(
+                params.model, mesh, face, transformed.clip_positions, transformed.normals);
+
+            raster::clip_triangle(vertices, size, [&](const std::array<vertex, 3> &visible) {
+                emit(raster::setup(visible, size));
+            });
+        }
+    }
+
+    if (!params.multithreaded) {
+        return;
+    }
+
+    raster::fill_binned(std::span<const raster::binned_triangle>{triangles},
+                        std::span<const raster::state<mesh_pixel_shader, ColorBlend>>{states}, size);
+}
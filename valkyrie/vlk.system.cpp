@@ -9,6 +9,8 @@
 #include <algorithm>
 
 #include "vlk.util.hpp"
+#include "vlk.pixels.hpp"
+#include "vlk.image_decoder.hpp"
 
 using namespace vlk;
 
@@ -65,6 +67,15 @@ image vlk::load_image(std::filesystem::path path, bool flip_vertically) {
         path = std::filesystem::current_path() / path;
     }
 
+    // Formats that decode_image() supports are decoded from a mapping of the file, GDI+ is left for the rest.
+    {
+        const mapped_file file{path};
+
+        if (detect_image_format(file.data()) != image_file_format::unknown) {
+            return decode_image(file.data(), flip_vertically);
+        }
+    }
+
     auto image = Gdiplus::Bitmap::FromFile(path.wstring().c_str());
 
     auto status = image->GetLastStatus();
@@ -82,22 +93,80 @@ image vlk::load_image(std::filesystem::path path, bool flip_vertically) {
 
     vlk::image result{image->GetWidth(), image->GetHeight(), 4};
 
-    for (size_t x = 0; x < image->GetWidth(); ++x) {
-        for (size_t y = 0; y < image->GetHeight(); ++y) {
-            Gdiplus::Color color;
-            image->GetPixel(static_cast<INT>(x),
-                            static_cast<INT>(flip_vertically ? image->GetHeight() - y - 1 : y), &color);
+    // Read the rows as 32-bit ARGB, which is BGRA in memory, instead of a pixel at a time.
+    const Gdiplus::Rect bounds{0, 0, static_cast<INT>(result.width()), static_cast<INT>(result.height())};
+    Gdiplus::BitmapData data;
 
-            *(result.at(x, y) + 0) = color.GetR();
-            *(result.at(x, y) + 1) = color.GetG();
-            *(result.at(x, y) + 2) = color.GetB();
-            *(result.at(x, y) + 3) = color.GetA();
-        }
+    if (image->LockBits(&bounds, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &data) != Gdiplus::Ok) {
+        throw std::runtime_error(std::format("Valkyrie: failed to load image {}.", path.string()));
+    }
+
+    const u8 *rows = static_cast<const u8 *>(data.Scan0);
+
+    for (size_t y = 0; y < result.height(); ++y) {
+        const size_t src_y = flip_vertically ? result.height() - y - 1 : y;
+        const u8 *row      = rows + static_cast<ptrdiff_t>(src_y) * data.Stride;
+
+        convert_rgba_to_bgra({&*result.at(0, y), result.width() * 4}, {row, result.width() * 4});
     }
 
+    image->UnlockBits(&data);
+
     return result;
 }
 
+mapped_file::mapped_file(std::filesystem::path path) {
+    m_file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (m_file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(std::format("Valkyrie: file not found {}.", path.string()));
+    }
+
+    LARGE_INTEGER size;
+
+    if (!GetFileSizeEx(m_file, &size)) {
+        close();
+        throw std::runtime_error(std::format("Valkyrie: failed to map file {}.", path.string()));
+    }
+
+    // Empty files can't be mapped.
+    if (size.QuadPart == 0) {
+        return;
+    }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    const void *view = m_mapping != nullptr ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+    if (view == nullptr) {
+        close();
+        throw std::runtime_error(std::format("Valkyrie: failed to map file {}.", path.string()));
+    }
+
+    m_data = {static_cast<const u8 *>(view), static_cast<size_t>(size.QuadPart)};
+}
+
+mapped_file::~mapped_file() {
+    close();
+}
+
+void mapped_file::close() {
+    if (!m_data.empty()) {
+        UnmapViewOfFile(m_data.data());
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+    }
+
+    m_data    = {};
+    m_mapping = nullptr;
+    m_file    = INVALID_HANDLE_VALUE;
+}
+
 #pragma pack(push, 1)
 struct wav_header {
     u32 riff_id;
@@ -272,7 +341,8 @@ window::window(const window_params &params)
     : m_should_close{false},
       m_width{params.width},
       m_height{params.height},
-      m_transparent{params.transparent} {
+      m_transparent{params.transparent},
+      m_premultiplied_alpha{params.premultiplied_alpha} {
     std::wstring wide_title;
     wide_title.assign(params.title.begin(), params.title.end());
 
@@ -337,19 +407,22 @@ static void blit(const window &window, HDC hdc) {
     DeleteDC(memory_hdc);
 }
 
-static void copy_pixels_rgba_to_argb(u32 *dst, const u32 *src, size_t len) {
-    for (size_t i = 0; i < len; ++i) {
-        // AABBGGRR to AARRGGBB.
-        dst[i] = (src[i] & 0xff00ff00) | ((src[i] & 0x00ff0000) >> 16) | ((src[i] & 0x000000ff) << 16);
-    }
-}
-
 void window::swap_buffers(const color_buffer &color_buf) {
     VLK_ASSERT(color_buf.width() == m_width && color_buf.height() == m_height,
                "Color buffer size does not match window size.");
 
-    copy_pixels_rgba_to_argb(pixels, reinterpret_cast<const u32 *>(&color_buf[0]),
-                             static_cast<size_t>(m_width * m_height));
+    // The bitmap is 32-bit ARGB, which is BGRA in memory.
+    color_buf.for_each_run([&](size_t x, size_t y, std::span<const color_rgba> run) {
+        u8 *dst       = reinterpret_cast<u8 *>(pixels + y * static_cast<size_t>(m_width) + x);
+        const u8 *src = reinterpret_cast<const u8 *>(run.data());
+
+        convert_rgba_to_bgra({dst, run.size() * 4}, {src, run.size() * 4});
+
+        // UpdateLayeredWindow() expects premultiplied alpha.
+        if (m_transparent && !m_premultiplied_alpha) {
+            premultiply_alpha({dst, run.size() * 4}, {dst, run.size() * 4});
+        }
+    });
 
     if (!m_transparent) {
         // Trigger redraw.
@@ -367,8 +440,7 @@ void window::set_icon(const image &image) {
     u32 *pixels          = new u32[image.width() * image.height()];
     HBITMAP color_bitmap = create_bitmap(hwnd, image.width(), image.height(), &pixels);
 
-    copy_pixels_rgba_to_argb(pixels, reinterpret_cast<const u32 *>(&*image.at(0, 0)),
-                             static_cast<size_t>(image.width() * image.height()));
+    convert_rgba_to_bgra({reinterpret_cast<u8 *>(pixels), image.data().size()}, image.data());
 
     HBITMAP mask_bitmap =
         CreateBitmap(static_cast<i32>(image.width()), static_cast<i32>(image.height()), 1, 1, nullptr);
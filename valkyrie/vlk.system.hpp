@@ -34,6 +34,28 @@ namespace vlk {
 
     image load_image(std::filesystem::path path, bool flip_vertically = false);
 
+    // A whole file mapped read-only into memory, the pages are read in as they're touched.
+    class mapped_file {
+    public:
+        mapped_file(std::filesystem::path path);
+        ~mapped_file();
+
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+
+        std::span<const u8> data() const { return m_data; }
+
+    private:
+#ifdef WINDOWS
+        HANDLE m_file    = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+#endif
+
+        std::span<const u8> m_data;
+
+        void close();
+    };
+
     using sound = std::vector<u8>;
 
     // Load a 16-bit PCM wav file.
@@ -48,6 +70,10 @@ namespace vlk {
         i32 height;
         bool default_ui  = true;
         bool transparent = false;
+
+        // Color buffers passed to swap_buffers() hold premultiplied alpha. Transparent windows need
+        // premultiplied colors, so straight alpha colors are premultiplied while they're copied otherwise.
+        bool premultiplied_alpha = false;
     };
 
     class window {
@@ -81,7 +107,40 @@ namespace vlk {
         i32 m_height;
 
         bool m_transparent;
+        bool m_premultiplied_alpha;
     };
 
-    model load_obj(std::filesystem::path path, bool flip_images_vertically = true);
+    // Compressed textures are BC1 for opaque images and BC3 otherwise. The uncompressed images aren't kept
+    // then, model::images stays empty. With premultiply_alpha the textures are premultiplied, draw them
+    // with premultiplied_color_blend_op.
+    //
+    // With use_cache the model is loaded from <path>.vlkm if the OBJ, its MTL files and images haven't
+    // changed since it was written, and the file is written after parsing otherwise.
+    model load_obj(std::filesystem::path path, bool flip_images_vertically = true,
+                   bool compress_textures = false, bool premultiply_alpha = false, bool use_cache = false);
+
+    /*
+     * Binary model files (.vlkm), a cache of a loaded model that needs no parsing.
+     *
+     * The geometry, meshes, materials, decoded images and built texture levels are stored as they are in
+     * memory, in aligned sections, and are copied out of a mapping of the file in one go per array. The file
+     * also lists the source files the model was loaded from with their sizes and write times, and a key for
+     * the options it was loaded with, e.g. whether images were flipped, so stale files can be detected.
+     *
+     * NOTE: The format is little endian with 64-bit sizes, it's meant as a local cache and not to be shipped.
+     */
+    void save_vlkm(const model &model, std::filesystem::path path,
+                   std::span<const std::filesystem::path> sources = {}, u64 key = 0);
+
+    // Whether path is a valid .vlkm file with the same key, whose sources haven't changed. Returns false
+    // rather than throwing for files that can't be read.
+    bool is_vlkm_current(std::filesystem::path path, u64 key = 0);
+
+    // Saved textures are used if they were built with the same options, otherwise they are built again from
+    // the saved images like in load_obj(). Models saved with compressed textures have no images to do that.
+    //
+    // The arrays of the model are copies of the sections, not views into the mapping, as model owns them in
+    // std::vector's. Each is a single bulk copy, so loading is still bound by disk reads rather than parsing.
+    model load_vlkm(std::filesystem::path path, bool compress_textures = false,
+                    bool premultiply_alpha = false);
 }  // namespace vlk
\ No newline at end of file
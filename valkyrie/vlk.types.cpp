@@ -1,3 +1,3 @@
 #include "vlk.types.hpp"
 
-std::byte vlk::operator""_byte(size_t value) { return static_cast<std::byte>(value); }
\ No newline at end of file
+std::byte vlk::operator""_byte(unsigned long long value) { return static_cast<std::byte>(value); }
\ No newline at end of file
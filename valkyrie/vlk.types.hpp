@@ -2,7 +2,9 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <climits>
 #include <cassert>
+#include <functional>
 #include <optional>
 #include <bit>
 
@@ -16,6 +18,21 @@
 #define VLK_ASSERT_FAST(expr, msg) VLK_ASSERT(expr, msg);
 #endif
 
+// SIMD instruction sets available at compile time. VLK_NO_SIMD builds the scalar code paths instead, e.g. to
+// test them against the SIMD ones.
+#if !defined(VLK_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VLK_SSE2
+#endif
+#if defined(__AVX2__)
+#define VLK_AVX2
+#endif
+#endif
+
+#if defined(VLK_SSE2) || defined(VLK_AVX2)
+#include <immintrin.h>
+#endif
+
 static_assert(std::endian::native == std::endian::little);
 static_assert(CHAR_BIT == 8);
 
@@ -40,5 +57,5 @@ namespace vlk {
     template <typename T>
     using optional_ref = std::optional<std::reference_wrapper<T>>;
 
-    std::byte operator""_byte(size_t value);
+    std::byte operator""_byte(unsigned long long value);
 }  // namespace vlk
\ No newline at end of file
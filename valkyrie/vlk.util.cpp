@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <cassert>
 #include <fstream>
+#include <atomic>
+#include <memory>
 
 using namespace vlk;
 
@@ -66,4 +68,98 @@ std::vector<u8> vlk::load_binary_file(std::filesystem::path path) {
     }
 
     return std::vector<u8>((std::istreambuf_iterator<u8>(file)), std::istreambuf_iterator<u8>());
+}
+
+thread_pool::thread_pool(size_t thread_count) {
+    for (size_t i = 0; i < thread_count; ++i) {
+        m_threads.emplace_back([this](std::stop_token stop_token) { work(stop_token); });
+    }
+}
+
+void thread_pool::submit(std::function<void()> task) {
+    {
+        std::scoped_lock lock{m_mutex};
+        m_tasks.push_back(std::move(task));
+    }
+
+    m_task_available.notify_one();
+}
+
+void thread_pool::parallel_for(size_t count, const std::function<void(size_t)> &func) {
+    if (count == 0) {
+        return;
+    }
+
+    struct job {
+        std::atomic<size_t> next{0};
+        size_t count;
+        const std::function<void(size_t)> &func;
+
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t active  = 0;
+        bool is_closed  = false;
+
+        job(size_t count, const std::function<void(size_t)> &func) : count{count}, func{func} {}
+
+        void run() {
+            for (size_t i = next++; i < count; i = next++) {
+                func(i);
+            }
+        }
+    };
+
+    auto shared_job = std::make_shared<job>(count, func);
+
+    const size_t helper_count = std::min(count - 1, thread_count());
+
+    for (size_t i = 0; i < helper_count; ++i) {
+        submit([shared_job] {
+            // Helpers that are dequeued after the caller has finished must not touch func.
+            {
+                std::scoped_lock lock{shared_job->mutex};
+                if (shared_job->is_closed) {
+                    return;
+                }
+                shared_job->active++;
+            }
+
+            shared_job->run();
+
+            std::scoped_lock lock{shared_job->mutex};
+            shared_job->active--;
+            shared_job->done.notify_all();
+        });
+    }
+
+    shared_job->run();
+
+    // Wait for helpers that are still working on their last index.
+    std::unique_lock lock{shared_job->mutex};
+    shared_job->is_closed = true;
+    shared_job->done.wait(lock, [&] { return shared_job->active == 0; });
+}
+
+thread_pool &thread_pool::global() {
+    static thread_pool pool;
+    return pool;
+}
+
+void thread_pool::work(std::stop_token stop_token) {
+    while (true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock lock{m_mutex};
+
+            if (!m_task_available.wait(lock, stop_token, [this] { return !m_tasks.empty(); })) {
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
 }
\ No newline at end of file
@@ -5,6 +5,12 @@
 #include <filesystem>
 #include <print>
 #include <bitset>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 
 #include "vlk.types.hpp"
 
@@ -31,4 +37,30 @@ namespace vlk {
     private:
         std::bitset<sizeof(T) * 8> flags;
     };
+
+    class thread_pool {
+    public:
+        thread_pool(size_t thread_count = std::max(std::thread::hardware_concurrency(), 1u));
+
+        size_t thread_count() const { return m_threads.size(); }
+
+        void submit(std::function<void()> task);
+
+        // Call func(i) for every i in [0, count) and block until all calls have returned.
+        // The calling thread helps out, so it's safe to call this from inside a task.
+        void parallel_for(size_t count, const std::function<void(size_t)> &func);
+
+        // Shared pool used by the renderer and loaders.
+        static thread_pool &global();
+
+    private:
+        void work(std::stop_token stop_token);
+
+        std::mutex m_mutex;
+        std::condition_variable_any m_task_available;
+        std::deque<std::function<void()>> m_tasks;
+
+        // Declared last so the threads are joined before the members above are destroyed.
+        std::vector<std::jthread> m_threads;
+    };
 }  // namespace vlk
@@ -170,17 +170,7 @@ namespace vlk {
 
         auto operator<=>(const vec3<T>& v) const = default;
 
-        vec3<T> operator*(const mat3& m) const {
-            vec3<T> result;
-            for (int y = 0; y < 3; y++) {
-                float i = 0;
-                for (int x = 0; x < 3; x++) {
-                    i += m[x][y] * (*this)[x];
-                }
-                result[y] = i;
-            }
-            return result;
-        }
+        vec3<T> operator*(const mat3& m) const;  // Defined in vlk.math.hpp, where mat3 is complete.
 
         vec3<T>& operator*=(const mat3& m) { return (*this = *this * m); }
 
@@ -326,17 +316,7 @@ namespace vlk {
 
         auto operator<=>(const vec4<T>& v) const = default;
 
-        vec4<T> operator*(const mat4& m) const {
-            vec4<T> result;
-            for (int y = 0; y < 4; y++) {
-                float i = 0;
-                for (int x = 0; x < 4; x++) {
-                    i += m[x][y] * (*this)[x];
-                }
-                result[y] = i;
-            }
-            return result;
-        }
+        vec4<T> operator*(const mat4& m) const;  // Defined in vlk.math.hpp, where mat4 is complete.
 
         vec4<T>& operator*=(const mat4& m) { return (*this = *this * m); }
 
@@ -55,6 +55,16 @@ int main() {
         {.title = "voxel world", .width = window_res.x(), .height = window_res.y()}
     };
 
+    // The cube data doesn't share vertices between faces, so every vertex gets its own index.
+    std::vector<vec4f> cube_clip_positions(cube_positions.size() / 3);
+    std::vector<attrib> cube_attribs;
+    std::vector<u32> cube_indices;
+
+    for (u32 i = 0; i < cube_clip_positions.size(); ++i) {
+        cube_attribs.emplace_back(vec2f{cube_tex_coords[i * 2 + 0], cube_tex_coords[i * 2 + 1]});
+        cube_indices.push_back(i);
+    }
+
     play_sound(music);
 
     while (!win.should_close()) {
@@ -70,71 +80,31 @@ int main() {
         const mat4 mvp_matrix    = model_matrix * view_matrix * projection_matrix;
         const mat3 normal_matrix = model_matrix.inverse().transpose();
 
-        for (size_t i = 0; i < 12; ++i) {
+        for (size_t i = 0; i < cube_clip_positions.size(); ++i) {
             const auto &p = cube_positions;
-            const auto &t = cube_tex_coords;
-
-            std::array positions{
-                vec4f{p[i * 9 + 0], p[i * 9 + 1], p[i * 9 + 2], 1.0f},
-                vec4f{p[i * 9 + 3], p[i * 9 + 4], p[i * 9 + 5], 1.0f},
-                vec4f{p[i * 9 + 6], p[i * 9 + 7], p[i * 9 + 8], 1.0f}
-            };
-
-            for (auto &pos : positions) {
-                pos *= mvp_matrix;
-            }
-
-            const std::array tex_coords{
-                vec2f{t[i * 6 + 0], t[i * 6 + 1]},
-                vec2f{t[i * 6 + 2], t[i * 6 + 3]},
-                vec2f{t[i * 6 + 4], t[i * 6 + 5]}
-            };
-
-            const std::array vertices{
-                vertex{positions[0], attrib{tex_coords[0]}},
-                vertex{positions[1], attrib{tex_coords[1]}},
-                vertex{positions[2], attrib{tex_coords[2]}}
-            };
-
-            vlk::render_triangle(
-                {.vertices     = vertices,
-                 .color_buf    = game_color_buf,
-                 .depth_buf    = game_depth_buf,
-                 .pixel_shader = [&](const vertex &vertex) {
-                     const vec2f tex_coord = vertex[0].data.xy();
-
-                     auto pixel = atlas.sample(tex_coord.x(), tex_coord.y());
-
-                     return color_rgba{*(pixel + 0), *(pixel + 1), *(pixel + 2), *(pixel + 3)};
-                 }});
-        }
-
-        // Draw game color buffer onto window color buffer.
-        const std::array vertices{
-            vertex{vec4f{-1.0f, -1.0f, 0.0f, 1.0f}, attrib{vec2f{0.0f, 0.0f}}},
-            vertex{vec4f{1.0f, -1.0f, 0.0f, 1.0f},  attrib{vec2f{1.0f, 0.0f}}},
-            vertex{vec4f{1.0f, 1.0f, 0.0f, 1.0f},   attrib{vec2f{1.0f, 1.0f}}},
-            vertex{vec4f{-1.0f, 1.0f, 0.0f, 1.0f},  attrib{vec2f{0.0f, 1.0f}}}
-        };
 
-        auto pixel_shader = [&](const vertex &vertex) {
-            const vec2f tex_coord = vertex[0].data.xy();
+            cube_clip_positions[i] = vec4f{p[i * 3 + 0], p[i * 3 + 1], p[i * 3 + 2], 1.0f} * mvp_matrix;
+        }
 
-            color_rgba pixel = game_color_buf.sample(tex_coord.x(), tex_coord.y());
+        vlk::render_indexed(basic_render_indexed_params{
+            .positions    = cube_clip_positions,
+            .attribs      = {cube_attribs},
+            .indices      = cube_indices,
+            .color_buf    = game_color_buf,
+            .depth_buf    = game_depth_buf,
+            .pixel_shader = [&](const vertex &vertex) {
+                const vec2f tex_coord = vertex[0].data.xy();
 
-            return pixel;
-        };
+                auto pixel = atlas.sample(tex_coord.x(), tex_coord.y());
 
-        vlk::render_triangle({
-            .vertices     = {vertices[0], vertices[1], vertices[2]},
-            .color_buf    = window_color_buf,
-            .pixel_shader = pixel_shader
-        });
+                return color_rgba{*(pixel + 0), *(pixel + 1), *(pixel + 2), *(pixel + 3)};
+            }});
 
-        vlk::render_triangle({
-            .vertices     = {vertices[2], vertices[3], vertices[0]},
-            .color_buf    = window_color_buf,
-            .pixel_shader = pixel_shader
+        // Draw game color buffer onto window color buffer.
+        vlk::resample_buffer({
+            .src    = game_color_buf,
+            .dst    = window_color_buf,
+            .filter = resample_filter::nearest
         });
 
         win.swap_buffers(window_color_buf);